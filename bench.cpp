@@ -0,0 +1,372 @@
+// Measures the throughput of the CPU triangles pass, resolve and blit, for regression tracking.
+// Configurations run one after another so that they don't disturb each other's timings.
+
+#include "softrast.h"
+#include "softrast_kernels.h"
+#include "jobs.h"
+#include "sweep.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+struct BenchConfig
+{
+	int Width = 640;
+	int Height = 360;
+	int NumTris = 16;
+	float MaxNumPixelsPercent = 1.0f;
+	int BinWidth = 0;
+	int BinHeight = 0;
+	int Layout = SOFTRAST_LAYOUT_LINEAR;
+	int NumThreads = 0;
+	int NumWarmups = 1;
+	int NumRepetitions = 5;
+	std::vector<int> NumFloatsPerVertex;
+	std::vector<int> PixelFormatIndices;
+	std::vector<int> SampleCountIndices;
+	const char* JSONPath = NULL;
+	const char* CSVPath = NULL;
+};
+
+enum BenchPass
+{
+	BENCH_PASS_TRIANGLES,
+	BENCH_PASS_RESOLVE,
+	BENCH_PASS_BLIT,
+	BENCH_PASS_COUNT
+};
+
+static const char* kBenchPassNames[BENCH_PASS_COUNT] = {
+	"triangles", "resolve", "blit"
+};
+
+struct BenchPassResult
+{
+	double MedianMs;
+	double P95Ms;
+
+	// work done by one run of the pass
+	double Tris;
+	double Pixels;
+	double Samples;
+};
+
+static void PrintUsage(const char* exe)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --width <int>         render target width (default 640)\n"
+		"  --height <int>        render target height (default 360)\n"
+		"  --tris <int>          number of triangles (default 16)\n"
+		"  --percent <float>     num pixels (percent), 0 to 1 (default 1)\n"
+		"  --bin <int>x<int>     bin size for tile-binned rasterization (default: immediate mode)\n"
+		"  --layout <int>        storage of the drawn target, converted to linear by the resolve: 0: linear, 1: 8x8 tiles\n"
+		"  --threads <int>       number of job system workers (default: all cores)\n"
+		"  --warmup <int>        untimed runs before the timed ones (default 1)\n"
+		"  --reps <int>          timed runs (default 5)\n"
+		"  --floats <list>       floats per vertex (default: all, 8 to 32)\n"
+		"  --formats <list>      pixel format indices (default: all, 0 to 2)\n"
+		"  --samples <list>      sample count indices (default: all, 0 to 3 for 1, 2, 4, 8 samples)\n"
+		"  --json <path>         write the results as JSON\n"
+		"  --csv <path>          write the results as CSV\n"
+		"Lists are comma-separated values or lo-hi ranges, e.g. 8,16,24-32, or \"all\".\n",
+		exe);
+}
+
+static bool ParseList(std::vector<int>* list, const char* arg, const char* val, int minValue, int maxValue)
+{
+	if (!SweepParseIntList(list, val, minValue, maxValue))
+	{
+		fprintf(stderr, "Error: invalid %s %s\n", arg, val);
+		return false;
+	}
+
+	return true;
+}
+
+static bool ParseArgs(BenchConfig* cfg, int argc, char* argv[])
+{
+	int maxSampleCountIndex = kSoftRastNumSampleCounts - 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const char* val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+			return false;
+
+		if (!val)
+		{
+			fprintf(stderr, "Error: missing value for %s\n", arg);
+			return false;
+		}
+
+		if (!strcmp(arg, "--width")) cfg->Width = atoi(val);
+		else if (!strcmp(arg, "--height")) cfg->Height = atoi(val);
+		else if (!strcmp(arg, "--tris")) cfg->NumTris = atoi(val);
+		else if (!strcmp(arg, "--percent")) cfg->MaxNumPixelsPercent = (float)atof(val);
+		else if (!strcmp(arg, "--bin"))
+		{
+			if (sscanf(val, "%dx%d", &cfg->BinWidth, &cfg->BinHeight) != 2 || cfg->BinWidth <= 0 || cfg->BinHeight <= 0)
+			{
+				fprintf(stderr, "Error: invalid bin size %s\n", val);
+				return false;
+			}
+		}
+		else if (!strcmp(arg, "--layout")) cfg->Layout = atoi(val);
+		else if (!strcmp(arg, "--threads")) cfg->NumThreads = atoi(val);
+		else if (!strcmp(arg, "--warmup")) cfg->NumWarmups = atoi(val);
+		else if (!strcmp(arg, "--reps")) cfg->NumRepetitions = atoi(val);
+		else if (!strcmp(arg, "--floats"))
+		{
+			if (!ParseList(&cfg->NumFloatsPerVertex, arg, val, 8, 32))
+				return false;
+		}
+		else if (!strcmp(arg, "--formats"))
+		{
+			if (!ParseList(&cfg->PixelFormatIndices, arg, val, 0, SOFTRAST_FORMAT_COUNT - 1))
+				return false;
+		}
+		else if (!strcmp(arg, "--samples"))
+		{
+			if (!ParseList(&cfg->SampleCountIndices, arg, val, 0, maxSampleCountIndex))
+				return false;
+		}
+		else if (!strcmp(arg, "--json")) cfg->JSONPath = val;
+		else if (!strcmp(arg, "--csv")) cfg->CSVPath = val;
+		else
+		{
+			fprintf(stderr, "Error: unknown option %s\n", arg);
+			return false;
+		}
+
+		i++;
+	}
+
+	if (cfg->Width <= 0 || cfg->Height <= 0)
+	{
+		fprintf(stderr, "Error: invalid size %dx%d\n", cfg->Width, cfg->Height);
+		return false;
+	}
+
+	if (cfg->Layout < 0 || cfg->Layout >= SOFTRAST_LAYOUT_COUNT)
+	{
+		fprintf(stderr, "Error: invalid layout %d\n", cfg->Layout);
+		return false;
+	}
+
+	if (cfg->NumTris < 0) cfg->NumTris = 0;
+	if (cfg->MaxNumPixelsPercent < 0.0f) cfg->MaxNumPixelsPercent = 0.0f;
+	if (cfg->NumThreads < 0) cfg->NumThreads = 0;
+	if (cfg->NumWarmups < 0) cfg->NumWarmups = 0;
+	if (cfg->NumRepetitions < 1) cfg->NumRepetitions = 1;
+
+	if (cfg->NumFloatsPerVertex.empty()) SweepParseIntList(&cfg->NumFloatsPerVertex, "all", 8, 32);
+	if (cfg->PixelFormatIndices.empty()) SweepParseIntList(&cfg->PixelFormatIndices, "all", 0, SOFTRAST_FORMAT_COUNT - 1);
+	if (cfg->SampleCountIndices.empty()) SweepParseIntList(&cfg->SampleCountIndices, "all", 0, maxSampleCountIndex);
+
+	return true;
+}
+
+// Nearest-rank percentile of sorted times.
+static double Percentile(const std::vector<double>& sorted, double p)
+{
+	size_t rank = (size_t)(p / 100.0 * (double)sorted.size() + 0.999999);
+	rank = std::min(std::max(rank, (size_t)1), sorted.size());
+	return sorted[rank - 1];
+}
+
+static double Median(const std::vector<double>& sorted)
+{
+	size_t n = sorted.size();
+	return n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+}
+
+static void RunConfig(const BenchConfig& cfg, const SweepConfig& config, BenchPassResult results[BENCH_PASS_COUNT])
+{
+	SoftRastTarget trianglesMS;
+	SoftRastTarget triangles;
+	SoftRastResize(&trianglesMS, config.Width, config.Height, config.Format, config.SampleCount, config.Layout);
+	SoftRastResize(&triangles, config.Width, config.Height, config.Format, 1);
+	std::vector<uint8_t> backbuffer((size_t)config.Width * config.Height * 4);
+
+	SoftRastDrawParams params;
+	params.NumTris = config.NumTris;
+	params.NumFloatsPerVertex = config.NumFloatsPerVertex;
+	params.MaxNumPixels = SoftRastMaxNumPixels(config.MaxNumPixelsPercent, config.Width, config.Height, config.NumTris);
+	params.BinWidth = config.BinWidth;
+	params.BinHeight = config.BinHeight;
+	params.BinOrder = config.BinOrder;
+
+	std::vector<double> times[BENCH_PASS_COUNT];
+	uint32_t pixelCounter = 0;
+
+	for (int run = 0; run < cfg.NumWarmups + cfg.NumRepetitions; run++)
+	{
+		auto t0 = std::chrono::high_resolution_clock::now();
+
+		// the clear is part of the triangles pass, as in ScenePaint
+		const float kClearColor[] = { 0, 0, 0, 0 };
+		SoftRastClear(&trianglesMS, kClearColor);
+		pixelCounter = SoftRastDraw(&trianglesMS, params);
+
+		auto t1 = std::chrono::high_resolution_clock::now();
+
+		SoftRastResolve(&triangles, &trianglesMS);
+
+		auto t2 = std::chrono::high_resolution_clock::now();
+
+		SoftRastBlit(backbuffer.data(), config.Width * 4, &triangles);
+
+		auto t3 = std::chrono::high_resolution_clock::now();
+
+		if (run < cfg.NumWarmups)
+			continue;
+
+		times[BENCH_PASS_TRIANGLES].push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+		times[BENCH_PASS_RESOLVE].push_back(std::chrono::duration<double, std::milli>(t2 - t1).count());
+		times[BENCH_PASS_BLIT].push_back(std::chrono::duration<double, std::milli>(t3 - t2).count());
+	}
+
+	// invocations past MaxNumPixels are discarded, so they don't write pixels
+	double shadedPixels = (double)std::min(pixelCounter, params.MaxNumPixels == UINT32_MAX ? UINT32_MAX : params.MaxNumPixels + 1);
+	double numPixels = (double)config.Width * config.Height;
+
+	results[BENCH_PASS_TRIANGLES].Tris = (double)config.NumTris;
+	results[BENCH_PASS_TRIANGLES].Pixels = shadedPixels;
+	results[BENCH_PASS_TRIANGLES].Samples = shadedPixels * config.SampleCount;
+	results[BENCH_PASS_RESOLVE].Tris = 0.0;
+	results[BENCH_PASS_RESOLVE].Pixels = numPixels;
+	results[BENCH_PASS_RESOLVE].Samples = numPixels * config.SampleCount;
+	results[BENCH_PASS_BLIT].Tris = 0.0;
+	results[BENCH_PASS_BLIT].Pixels = numPixels;
+	results[BENCH_PASS_BLIT].Samples = numPixels;
+
+	for (int pass = 0; pass < BENCH_PASS_COUNT; pass++)
+	{
+		std::sort(times[pass].begin(), times[pass].end());
+		results[pass].MedianMs = Median(times[pass]);
+		results[pass].P95Ms = Percentile(times[pass], 95.0);
+	}
+}
+
+// millions per second at the median time
+static double Rate(double count, double ms)
+{
+	return ms > 0.0 ? count / (ms * 1e-3) * 1e-6 : 0.0;
+}
+
+int main(int argc, char* argv[])
+{
+	BenchConfig cfg;
+	if (!ParseArgs(&cfg, argc, argv))
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	SweepConfig base;
+	base.Width = cfg.Width;
+	base.Height = cfg.Height;
+	base.NumTris = cfg.NumTris;
+	base.MaxNumPixelsPercent = cfg.MaxNumPixelsPercent;
+	base.BinWidth = cfg.BinWidth;
+	base.BinHeight = cfg.BinHeight;
+	base.Layout = (SoftRastLayout)cfg.Layout;
+
+	SweepAxes axes;
+	axes.NumFloatsPerVertex = cfg.NumFloatsPerVertex;
+	for (int i : cfg.PixelFormatIndices)
+		axes.Formats.push_back((SoftRastFormat)i);
+	for (int i : cfg.SampleCountIndices)
+		axes.SampleCounts.push_back(kSoftRastSampleCounts[i]);
+
+	std::vector<SweepConfig> configs = SweepEnumerate(base, axes);
+
+	FILE* json = NULL;
+	FILE* csv = NULL;
+	if (cfg.JSONPath && !(json = fopen(cfg.JSONPath, "w")))
+	{
+		fprintf(stderr, "Error: could not open %s for writing\n", cfg.JSONPath);
+		return 1;
+	}
+	if (cfg.CSVPath && !(csv = fopen(cfg.CSVPath, "w")))
+	{
+		fprintf(stderr, "Error: could not open %s for writing\n", cfg.CSVPath);
+		return 1;
+	}
+
+	JobsInit(cfg.NumThreads);
+
+	printf("%dx%d, %d tris, percent %g, %s, %s layout, %d workers, %s kernels, %d warmup + %d timed runs\n",
+		cfg.Width, cfg.Height, cfg.NumTris, cfg.MaxNumPixelsPercent, cfg.BinWidth > 0 ? "binned" : "immediate", SoftRastLayoutName(base.Layout),
+		JobsGetNumWorkers(), SoftRastISAName(SoftRastGetISA()), cfg.NumWarmups, cfg.NumRepetitions);
+	printf("%-20s %7s %6s %-10s %10s %10s %10s %10s %10s\n", "format", "samples", "floats", "pass", "median ms", "p95 ms", "Mtris/s", "Mpixels/s", "Msamples/s");
+
+	if (json)
+	{
+		fprintf(json, "{\n  \"width\": %d, \"height\": %d, \"tris\": %d, \"percent\": %g, \"bin_width\": %d, \"bin_height\": %d, \"layout\": \"%s\",\n",
+			cfg.Width, cfg.Height, cfg.NumTris, cfg.MaxNumPixelsPercent, cfg.BinWidth, cfg.BinHeight, SoftRastLayoutName(base.Layout));
+		fprintf(json, "  \"workers\": %d, \"isa\": \"%s\", \"warmup\": %d, \"reps\": %d,\n  \"results\": [\n",
+			JobsGetNumWorkers(), SoftRastISAName(SoftRastGetISA()), cfg.NumWarmups, cfg.NumRepetitions);
+	}
+	if (csv)
+	{
+		fprintf(csv, "format,samples,floats,pass,median_ms,p95_ms,mtris_per_s,mpixels_per_s,msamples_per_s\n");
+	}
+
+	int numRows = 0;
+	for (const SweepConfig& config : configs)
+	{
+		BenchPassResult results[BENCH_PASS_COUNT];
+		RunConfig(cfg, config, results);
+
+		for (int pass = 0; pass < BENCH_PASS_COUNT; pass++)
+		{
+			const BenchPassResult& r = results[pass];
+			double mtris = Rate(r.Tris, r.MedianMs);
+			double mpixels = Rate(r.Pixels, r.MedianMs);
+			double msamples = Rate(r.Samples, r.MedianMs);
+			const char* format = SoftRastFormatName(config.Format);
+
+			printf("%-20s %7d %6d %-10s %10.3f %10.3f %10.4f %10.2f %10.2f\n",
+				format, config.SampleCount, config.NumFloatsPerVertex, kBenchPassNames[pass], r.MedianMs, r.P95Ms, mtris, mpixels, msamples);
+
+			if (json)
+			{
+				fprintf(json, "%s    { \"format\": \"%s\", \"samples\": %d, \"floats\": %d, \"pass\": \"%s\", \"median_ms\": %.4f, \"p95_ms\": %.4f, "
+					"\"mtris_per_s\": %.4f, \"mpixels_per_s\": %.4f, \"msamples_per_s\": %.4f }",
+					numRows > 0 ? ",\n" : "", format, config.SampleCount, config.NumFloatsPerVertex, kBenchPassNames[pass],
+					r.MedianMs, r.P95Ms, mtris, mpixels, msamples);
+			}
+			if (csv)
+			{
+				fprintf(csv, "%s,%d,%d,%s,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+					format, config.SampleCount, config.NumFloatsPerVertex, kBenchPassNames[pass], r.MedianMs, r.P95Ms, mtris, mpixels, msamples);
+			}
+			numRows++;
+		}
+
+		fflush(stdout);
+	}
+
+	bool ok = true;
+	if (json)
+	{
+		fprintf(json, "\n  ]\n}\n");
+		ok = !ferror(json) && ok;
+		fclose(json);
+	}
+	if (csv)
+	{
+		ok = !ferror(csv) && ok;
+		fclose(csv);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+#include "capture.h"
+#include "softrast.h"
+
+#include <cstdio>
+
+static_assert(sizeof(CaptureFileHeader) == 64, "capture files start with a 64-byte header");
+
+bool CaptureFileOpen(CaptureFile* capture, const char* path)
+{
+	*capture = CaptureFile();
+
+	if (!MappedFileOpen(&capture->Mapping, path))
+	{
+		fprintf(stderr, "Error: could not map %s\n", path);
+		return false;
+	}
+
+	const CaptureFileHeader* header = (const CaptureFileHeader*)capture->Mapping.Data;
+	if (capture->Mapping.Size < sizeof(CaptureFileHeader) || header->Magic != kCaptureFileMagic || header->Version != kCaptureFileVersion)
+	{
+		fprintf(stderr, "Error: %s is not a version %u capture file\n", path, kCaptureFileVersion);
+		CaptureFileClose(capture);
+		return false;
+	}
+
+	if (header->Width == 0 || header->Height == 0 || header->PixelFormatIndex >= SOFTRAST_FORMAT_COUNT || header->SampleCountIndex >= (uint32_t)kSoftRastNumSampleCounts ||
+		header->NumFloatsPerVertex < 8 || header->NumFloatsPerVertex > 32)
+	{
+		fprintf(stderr, "Error: %s has an invalid configuration\n", path);
+		CaptureFileClose(capture);
+		return false;
+	}
+
+	bool mesh = (header->ShaderFlags & CAPTURE_SHADER_MESH) != 0;
+	size_t positionsSize = mesh ? (size_t)header->NumVertices * 4 * sizeof(float) : 0;
+	size_t indicesSize = mesh ? (size_t)header->NumTris * 3 * sizeof(uint32_t) : 0;
+	if (capture->Mapping.Size != sizeof(CaptureFileHeader) + positionsSize + indicesSize)
+	{
+		fprintf(stderr, "Error: %s has %zu bytes, its header needs %zu\n",
+			path, capture->Mapping.Size, sizeof(CaptureFileHeader) + positionsSize + indicesSize);
+		CaptureFileClose(capture);
+		return false;
+	}
+
+	const uint8_t* data = (const uint8_t*)capture->Mapping.Data;
+	capture->Header = header;
+	if (mesh)
+	{
+		capture->Mesh.Positions = (const float*)(data + sizeof(CaptureFileHeader));
+		capture->Mesh.Indices = (const uint32_t*)(data + sizeof(CaptureFileHeader) + positionsSize);
+		capture->Mesh.NumVertices = header->NumVertices;
+		capture->Mesh.NumTris = header->NumTris;
+	}
+	return true;
+}
+
+void CaptureFileClose(CaptureFile* capture)
+{
+	MappedFileClose(&capture->Mapping);
+	*capture = CaptureFile();
+}
+
+bool CaptureFileWrite(const char* path, const CaptureFileHeader& header, const float* positions, const uint32_t* indices)
+{
+	FILE* f = fopen(path, "wb");
+	if (!f)
+	{
+		fprintf(stderr, "Error: could not open %s for writing\n", path);
+		return false;
+	}
+
+	CaptureFileHeader h = header;
+	h.Magic = kCaptureFileMagic;
+	h.Version = kCaptureFileVersion;
+	fwrite(&h, sizeof(h), 1, f);
+	if (h.ShaderFlags & CAPTURE_SHADER_MESH)
+	{
+		fwrite(positions, 4 * sizeof(float), h.NumVertices, f);
+		fwrite(indices, 3 * sizeof(uint32_t), h.NumTris, f);
+	}
+
+	bool ok = !ferror(f);
+	fclose(f);
+	if (!ok)
+		fprintf(stderr, "Error: could not write %s\n", path);
+	return ok;
+}
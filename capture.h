@@ -0,0 +1,63 @@
+#pragma once
+
+// Captures of one ScenePaint invocation, with everything needed to re-execute it on the CPU rasterizer
+// (see --replay in headless.cpp), e.g. to reproduce a Toolbox configuration on another machine.
+//
+// Capture files are memory-mapped and used in place, like mesh files. Layout, all little-endian:
+// CaptureFileHeader (64 bytes),
+// then, if the MESH flag is set, NumVertices clip space positions (float4) and NumTris * 3 uint32 indices, as in mesh files (see mesh.h).
+// Only the drawn triangles are stored. Captures of the half-screen triangle have no geometry.
+
+#include "mesh.h"
+
+#include <cstdint>
+
+// "TBCP"
+static const uint32_t kCaptureFileMagic = 0x50434254;
+static const uint32_t kCaptureFileVersion = 1;
+
+// The shader permutation, the macros of triangles.hlsl other than NUM_EXTRA_FLOATs (NumFloatsPerVertex - 8).
+enum CaptureShaderFlags
+{
+	CAPTURE_SHADER_MESH = 1 << 0,
+	CAPTURE_SHADER_INDEXED = 1 << 1,
+	CAPTURE_SHADER_ORDER_CAPTURE = 1 << 2
+};
+
+struct CaptureFileHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	// viewport, which covers the whole target
+	uint32_t Width;
+	uint32_t Height;
+	// Toolbox list indices: R8G8B8A8_UNORM, R16G16B16A16_UNORM, R32G32B32A32_FLOAT, and 1, 2, 4, 8 samples
+	uint32_t PixelFormatIndex;
+	uint32_t SampleCountIndex;
+	uint32_t NumTris;
+	uint32_t NumFloatsPerVertex;
+	// MaxNumPixelsCBV
+	uint32_t MaxNumPixels;
+	uint32_t ShaderFlags;
+	uint32_t NumVertices;
+	// keeps the positions 16-byte aligned
+	uint32_t Reserved[5];
+};
+
+struct CaptureFile
+{
+	// points into the mapping
+	const CaptureFileHeader* Header = NULL;
+	// the geometry, without a mapping of its own, empty without the MESH flag
+	MeshFile Mesh;
+
+	MappedFile Mapping;
+};
+
+// Maps the file and checks its header and size. Prints an error and returns false on failure.
+bool CaptureFileOpen(CaptureFile* capture, const char* path);
+void CaptureFileClose(CaptureFile* capture);
+
+// Writes header, with its Magic and Version filled in, followed by the geometry if the MESH flag is set.
+// Prints an error and returns false on failure.
+bool CaptureFileWrite(const char* path, const CaptureFileHeader& header, const float* positions, const uint32_t* indices);
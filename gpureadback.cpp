@@ -0,0 +1,128 @@
+#include "gpureadback.h"
+#include "dxutil.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+struct GpuReadbackSlot
+{
+	ID3D11Buffer* Counter;
+	// recreated when the resolved texture changes
+	ID3D11Texture2D* Image;
+	D3D11_TEXTURE2D_DESC ImageDesc;
+	bool ReadImage;
+	UINT32 MaxNumPixels;
+};
+
+static ID3D11Device* g_GpuReadbackDevice;
+static ID3D11DeviceContext* g_GpuReadbackDeviceContext;
+static std::vector<GpuReadbackSlot> g_GpuReadbackSlots;
+
+void GpuReadbackInit(ID3D11Device* dev, ID3D11DeviceContext* dc, int depth)
+{
+	g_GpuReadbackDevice = dev;
+	g_GpuReadbackDeviceContext = dc;
+
+	g_GpuReadbackSlots.resize(std::max(depth, 1));
+	for (GpuReadbackSlot& slot : g_GpuReadbackSlots)
+	{
+		slot = GpuReadbackSlot();
+		CHECKHR(dev->CreateBuffer(
+			&CD3D11_BUFFER_DESC(sizeof(UINT32), 0, D3D11_USAGE_STAGING, D3D11_CPU_ACCESS_READ),
+			NULL,
+			&slot.Counter));
+	}
+}
+
+static SoftRastFormat GetSoftRastFormat(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R16G16B16A16_UNORM: return SOFTRAST_FORMAT_R16G16B16A16_UNORM;
+	case DXGI_FORMAT_R32G32B32A32_FLOAT: return SOFTRAST_FORMAT_R32G32B32A32_FLOAT;
+	default: return SOFTRAST_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+void GpuReadbackIssue(ReadbackRing* ring, uint64_t frame, ID3D11UnorderedAccessView* counterUAV, UINT32 maxNumPixels, ID3D11Texture2D* resolved)
+{
+	ID3D11DeviceContext* dc = g_GpuReadbackDeviceContext;
+
+	int slotIndex = ReadbackIssue(ring, frame);
+	GpuReadbackSlot& slot = g_GpuReadbackSlots[slotIndex];
+	slot.MaxNumPixels = maxNumPixels;
+	slot.ReadImage = resolved != NULL;
+
+	if (resolved)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		resolved->GetDesc(&desc);
+		desc.Usage = D3D11_USAGE_STAGING;
+		desc.BindFlags = 0;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		desc.MiscFlags = 0;
+
+		if (!slot.Image || memcmp(&desc, &slot.ImageDesc, sizeof(desc)) != 0)
+		{
+			if (slot.Image) slot.Image->Release();
+			CHECKHR(g_GpuReadbackDevice->CreateTexture2D(&desc, NULL, &slot.Image));
+			slot.ImageDesc = desc;
+		}
+
+		dc->CopyResource(slot.Image, resolved);
+	}
+
+	dc->CopyStructureCount(slot.Counter, 0, counterUAV);
+}
+
+// Returns false if the copies aren't done yet.
+static bool ReadSlot(GpuReadbackSlot* slot, ReadbackResult* result)
+{
+	ID3D11DeviceContext* dc = g_GpuReadbackDeviceContext;
+
+	// the counter is copied last, so the image is usually done when it is
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (dc->Map(slot->Counter, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped) != S_OK)
+		return false;
+	UINT32 pixelCounter = *(const UINT32*)mapped.pData;
+	dc->Unmap(slot->Counter, 0);
+
+	result->Image.clear();
+	if (slot->ReadImage)
+	{
+		if (dc->Map(slot->Image, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped) != S_OK)
+			return false;
+
+		result->Width = (int)slot->ImageDesc.Width;
+		result->Height = (int)slot->ImageDesc.Height;
+		result->Format = GetSoftRastFormat(slot->ImageDesc.Format);
+
+		size_t rowSize = (size_t)result->Width * SoftRastBytesPerSample(result->Format);
+		result->Image.resize(rowSize * result->Height);
+		for (int y = 0; y < result->Height; y++)
+			memcpy(&result->Image[y * rowSize], (const uint8_t*)mapped.pData + (size_t)y * mapped.RowPitch, rowSize);
+
+		dc->Unmap(slot->Image, 0);
+	}
+
+	result->PixelCounter = pixelCounter;
+	// orders 0 to MaxNumPixels are shaded, the others discarded (see triangles.hlsl)
+	result->PixelsShaded = slot->MaxNumPixels < pixelCounter ? slot->MaxNumPixels + 1 : pixelCounter;
+	return true;
+}
+
+void GpuReadbackUpdate(ReadbackRing* ring)
+{
+	for (uint64_t i = ring->NumPolled; i < ring->NumIssued; i++)
+	{
+		int slotIndex = (int)(i % ring->Results.size());
+		if (ring->Ready[slotIndex])
+			continue;
+
+		if (!ReadSlot(&g_GpuReadbackSlots[slotIndex], &ring->Results[slotIndex]))
+			break;
+
+		ring->Ready[slotIndex] = true;
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// GPU backend of the readback ring (see readback.h). Each frame's PixelCounterUAV counter and, optionally, resolved image
+// are copied to the staging resources of its slot, which are mapped once the copies are done, without waiting for them.
+
+#include "readback.h"
+
+#include <d3d11.h>
+
+// depth must be the one of the rings used.
+void GpuReadbackInit(ID3D11Device* dev, ID3D11DeviceContext* dc, int depth);
+
+// resolved can be NULL not to read back the image.
+void GpuReadbackIssue(ReadbackRing* ring, uint64_t frame, ID3D11UnorderedAccessView* counterUAV, UINT32 maxNumPixels, ID3D11Texture2D* resolved);
+
+// Fills in the frames whose copies are done, oldest first.
+void GpuReadbackUpdate(ReadbackRing* ring);
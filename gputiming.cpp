@@ -0,0 +1,114 @@
+#include "gputiming.h"
+#include "dxutil.h"
+
+// frames of queries in flight
+static const int kGpuTimingNumQuerySets = 4;
+
+struct GpuTimingQuerySet
+{
+	ID3D11Query* Disjoint;
+	ID3D11Query* Begin[TIMING_PASS_COUNT];
+	ID3D11Query* End[TIMING_PASS_COUNT];
+	bool Timed[TIMING_PASS_COUNT];
+	// issued and not read back yet
+	bool Pending;
+};
+
+static ID3D11DeviceContext* g_GpuTimingDeviceContext;
+static GpuTimingQuerySet g_GpuTimingQuerySets[kGpuTimingNumQuerySets];
+// query sets are used in order, round-robin
+static uint64_t g_GpuTimingNumFrames;
+static uint64_t g_GpuTimingNumFramesRead;
+
+void GpuTimingInit(ID3D11Device* dev, ID3D11DeviceContext* dc)
+{
+	g_GpuTimingDeviceContext = dc;
+
+	for (GpuTimingQuerySet& set : g_GpuTimingQuerySets)
+	{
+		CHECKHR(dev->CreateQuery(&CD3D11_QUERY_DESC(D3D11_QUERY_TIMESTAMP_DISJOINT), &set.Disjoint));
+		for (int pass = 0; pass < TIMING_PASS_COUNT; pass++)
+		{
+			CHECKHR(dev->CreateQuery(&CD3D11_QUERY_DESC(D3D11_QUERY_TIMESTAMP), &set.Begin[pass]));
+			CHECKHR(dev->CreateQuery(&CD3D11_QUERY_DESC(D3D11_QUERY_TIMESTAMP), &set.End[pass]));
+		}
+	}
+}
+
+// Returns false if the queries aren't ready.
+static bool ReadQuerySet(GpuTimingQuerySet* set)
+{
+	ID3D11DeviceContext* dc = g_GpuTimingDeviceContext;
+
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+	if (dc->GetData(set->Disjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+
+	TimingFrame frame;
+	for (int pass = 0; pass < TIMING_PASS_COUNT; pass++)
+	{
+		if (!set->Timed[pass])
+			continue;
+
+		UINT64 begin, end;
+		if (dc->GetData(set->Begin[pass], &begin, sizeof(begin), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+			dc->GetData(set->End[pass], &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+			return false;
+
+		frame.Ms[pass] = (float)((double)(end - begin) * 1000.0 / (double)disjoint.Frequency);
+	}
+
+	// the timestamps are unreliable, e.g. the clock changed during the frame
+	if (!disjoint.Disjoint)
+		TimingPushFrame(frame);
+	return true;
+}
+
+void GpuTimingBeginFrame()
+{
+	GpuTimingQuerySet& set = g_GpuTimingQuerySets[g_GpuTimingNumFrames % kGpuTimingNumQuerySets];
+
+	// still not ready after kGpuTimingNumQuerySets frames: drop it rather than wait
+	if (set.Pending)
+	{
+		set.Pending = false;
+		g_GpuTimingNumFramesRead++;
+	}
+
+	for (int pass = 0; pass < TIMING_PASS_COUNT; pass++)
+		set.Timed[pass] = false;
+
+	g_GpuTimingDeviceContext->Begin(set.Disjoint);
+}
+
+void GpuTimingEndFrame()
+{
+	GpuTimingQuerySet& set = g_GpuTimingQuerySets[g_GpuTimingNumFrames % kGpuTimingNumQuerySets];
+	g_GpuTimingDeviceContext->End(set.Disjoint);
+	set.Pending = true;
+	g_GpuTimingNumFrames++;
+
+	// oldest first, so that frames are pushed in order
+	while (g_GpuTimingNumFramesRead < g_GpuTimingNumFrames)
+	{
+		GpuTimingQuerySet& oldest = g_GpuTimingQuerySets[g_GpuTimingNumFramesRead % kGpuTimingNumQuerySets];
+		if (!ReadQuerySet(&oldest))
+			break;
+
+		oldest.Pending = false;
+		g_GpuTimingNumFramesRead++;
+	}
+}
+
+void GpuTimingBegin(TimingPass pass)
+{
+	GpuTimingQuerySet& set = g_GpuTimingQuerySets[g_GpuTimingNumFrames % kGpuTimingNumQuerySets];
+	g_GpuTimingDeviceContext->End(set.Begin[pass]);
+}
+
+void GpuTimingEnd(TimingPass pass)
+{
+	GpuTimingQuerySet& set = g_GpuTimingQuerySets[g_GpuTimingNumFrames % kGpuTimingNumQuerySets];
+	g_GpuTimingDeviceContext->End(set.End[pass]);
+	set.Timed[pass] = true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// GPU timings of the Toolbox passes, with D3D11 timestamp queries, pushed to the timing ring buffer (see timing.h).
+// Queries are read back a few frames later without waiting for the GPU, so the pushed frames lag behind the drawn ones.
+// Frames whose queries aren't ready by the time their query set is needed again, or that are disjoint, are dropped.
+
+#include "timing.h"
+
+#include <d3d11.h>
+
+void GpuTimingInit(ID3D11Device* dev, ID3D11DeviceContext* dc);
+
+void GpuTimingBeginFrame();
+// Pushes the frames whose queries are ready.
+void GpuTimingEndFrame();
+
+// A pass can only be timed once per frame.
+void GpuTimingBegin(TimingPass pass);
+void GpuTimingEnd(TimingPass pass);
+
+struct GpuTimingScope
+{
+	TimingPass Pass;
+
+	GpuTimingScope(TimingPass pass)
+		: Pass(pass)
+	{
+		GpuTimingBegin(pass);
+	}
+
+	~GpuTimingScope()
+	{
+		GpuTimingEnd(Pass);
+	}
+};
@@ -0,0 +1,826 @@
+// Runs the triangles pass with the CPU rasterizer, without a window or a D3D device.
+
+#include "softrast.h"
+#include "softrast_kernels.h"
+#include "jobs.h"
+#include "sweep.h"
+#include "mesh.h"
+#include "workloads.h"
+#include "vcache.h"
+#include "meshopt.h"
+#include "capture.h"
+#include "timing.h"
+#include "trace.h"
+#include "readback.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+struct HeadlessConfig
+{
+	int Width = 1280;
+	int Height = 720;
+	// -1: all the triangles of the mesh, or none without a mesh
+	int NumTris = -1;
+	float MaxNumPixelsPercent = 0.0f;
+	int NumFloatsPerVertex = kSoftRastNumNonExtraFloats;
+	int PixelFormatIndex = 0;
+	int SampleCountIndex = 0;
+	int Layout = SOFTRAST_LAYOUT_LINEAR;
+	int BinWidth = 0;
+	int BinHeight = 0;
+	int BinOrder = SOFTRAST_BIN_ORDER_ROW_MAJOR;
+	int ParamBufferKB = 0;
+	int NumThreads = 0;
+	int ISA = -1;
+	bool PrintJobStats = false;
+	int NumFrames = 1;
+	const char* TraceOutputPath = NULL;
+	const char* OutputPath = NULL;
+	const char* OrderOutputPath = NULL;
+	float ScrubPercent = -1.0f;
+	const char* MeshPath = NULL;
+	int Workload = WORKLOAD_HALF_SCREEN;
+	float Overlap = 1.0f;
+	uint32_t Seed = 1;
+	const char* MeshOutputPath = NULL;
+	bool Indexed = false;
+	VCacheParams VCache;
+	int Reorder = MESHOPT_NONE;
+
+	// sweep mode if any of these is set
+	std::vector<int> SweepWorkloads;
+	std::vector<int> SweepNumTris;
+	std::vector<int> SweepNumFloatsPerVertex;
+	std::vector<int> SweepPixelFormatIndices;
+	std::vector<int> SweepSampleCountIndices;
+	const char* SweepOutputPath = NULL;
+
+	// capture files to replay, each ReplayReps times
+	std::vector<const char*> ReplayPaths;
+	int ReplayReps = 1;
+	const char* CaptureOutputPath = NULL;
+	// set by a replayed capture: if >= 0, used instead of MaxNumPixelsPercent
+	int64_t MaxNumPixels = -1;
+	bool CaptureOrder = false;
+};
+
+static void PrintUsage(const char* exe)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --width <int>         render target width (default 1280)\n"
+		"  --height <int>        render target height (default 720)\n"
+		"  --tris <int>          number of triangles (default 0, or all the triangles of the mesh)\n"
+		"  --mesh <path>         draw the triangles of a mesh file (see mesh.h) instead of the half-screen triangle\n"
+		"  --workload <int>      generate the triangles instead (see workloads.h): 0: half-screen, 1: random, 2: slivers,\n"
+		"                        3: full-screen quads, 4: grid, 5: fans, 6: strips\n"
+		"  --overlap <float>     average number of generated triangles covering a pixel (default 1)\n"
+		"  --seed <int>          seed of the generated triangles (default 1)\n"
+		"  --reorder <int>       reorder the triangles of the mesh or generated triangles (see meshopt.h), and report the\n"
+		"                        effects: 0: none, 1: vertex cache, 2: bin locality, 3: both\n"
+		"  --mesh-out <path>     write the drawn triangles, generated and/or reordered, as a mesh file\n"
+		"  --indexed <0|1>       draw the mesh or generated triangles indexed (DrawIndexed instead of Draw)\n"
+		"  --vcache <int>        simulated post-transform vertex cache size (default 32)\n"
+		"  --vcache-policy <int> 0: FIFO, 1: LRU\n"
+		"  --vcache-batch <int>  triangles per vertex batch, each starting with an empty cache (default 0: no batches)\n"
+		"  --percent <float>     num pixels (percent), 0 to 1 (default 0)\n"
+		"  --floats <int>        num floats per vertex, 8 to 32 (default 8)\n"
+		"  --format <int>        0: R8G8B8A8_UNORM, 1: R16G16B16A16_UNORM, 2: R32G32B32A32_FLOAT\n"
+		"  --samples <int>       sample count index, 0 to 3 for 1, 2, 4, 8 samples\n"
+		"  --layout <int>        storage of the drawn target, converted to linear by the resolve: 0: linear, 1: 8x8 tiles\n"
+		"  --bin <int>x<int>     bin size for tile-binned rasterization, e.g. 64x64 (default: immediate mode)\n"
+		"  --bin-order <int>     0: row-major, 1: column-major, 2: serpentine, 3: morton\n"
+		"  --param-buffer <int>  capacity in KB of the modeled parameter buffer of binned draws, partially flushed when full\n"
+		"                        (default 0: unlimited)\n"
+		"  --threads <int>       number of job system workers (default: all cores)\n"
+		"  --job-stats <0|1>     print per-worker job system statistics\n"
+		"  --frames <int>        draw the frame this many times, and print the p50 and p99 times of its passes (default 1)\n"
+		"  --trace-out <path>    record when each thread bins, counts and shades bins, resolves and exports, and write it as\n"
+		"                        a Chrome trace (chrome://tracing or ui.perfetto.dev). Works in sweep and replay modes too\n"
+		"  --isa <int>           0: scalar, 1: SSE2, 2: AVX2, 3: AVX-512 (default: best supported by the CPU)\n"
+		"  --out <path>          write the blitted image as a binary PPM\n"
+		"  --order-out <path>    capture the shading order and write the order buffer (see WriteOrderBuffer)\n"
+		"  --scrub <float>       then rebuild the image for another num pixels (percent) from the captured shading order,\n"
+		"                        as the Toolbox does when only the percent changes. Half-screen triangle only\n"
+		"\n"
+		"Sweep mode renders every combination of the swept values, several at a time, instead of a single image.\n"
+		"Lists are comma-separated values or lo-hi ranges, e.g. 0,100,500-510, or \"all\" for the whole range.\n"
+		"  --sweep-workloads <list>  workloads (all: 0 to 6)\n"
+		"  --sweep-tris <list>       triangle counts\n"
+		"  --sweep-floats <list>     floats per vertex (all: 8 to 32)\n"
+		"  --sweep-formats <list>    pixel format indices (all: 0 to 2)\n"
+		"  --sweep-samples <list>    sample count indices (all: 0 to 3)\n"
+		"  --sweep-out <path>        results as CSV, or JSON if the path ends in .json (default: CSV to stdout)\n"
+		"\n"
+		"Captures record the configuration and geometry of a frame (see capture.h), from the Toolbox or --capture-out.\n"
+		"  --capture-out <path>      write the frame drawn as a capture file\n"
+		"  --replay <path>           draw a capture instead, with its size, format, sample count, triangles, floats per vertex,\n"
+		"                            max num pixels and geometry; bin, layout and job options still apply. Can be repeated\n"
+		"  --replay-reps <int>       draw each capture this many times (default 1). With several captures or repetitions,\n"
+		"                            they're drawn several at a time and written as with --sweep-out, image hashes included\n",
+		exe);
+}
+
+// "all" isn't allowed when there's no maximum.
+static bool ParseSweepList(std::vector<int>* list, const char* arg, const char* val, int minValue, int maxValue)
+{
+	if ((maxValue == INT_MAX && !strcmp(val, "all")) || !SweepParseIntList(list, val, minValue, maxValue))
+	{
+		fprintf(stderr, "Error: invalid %s %s\n", arg, val);
+		return false;
+	}
+
+	return true;
+}
+
+static bool ParseArgs(HeadlessConfig* cfg, int argc, char* argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const char* val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+			return false;
+
+		if (!val)
+		{
+			fprintf(stderr, "Error: missing value for %s\n", arg);
+			return false;
+		}
+
+		if (!strcmp(arg, "--width")) cfg->Width = atoi(val);
+		else if (!strcmp(arg, "--height")) cfg->Height = atoi(val);
+		else if (!strcmp(arg, "--tris")) cfg->NumTris = std::max(atoi(val), 0);
+		else if (!strcmp(arg, "--mesh")) cfg->MeshPath = val;
+		else if (!strcmp(arg, "--workload")) cfg->Workload = atoi(val);
+		else if (!strcmp(arg, "--overlap")) cfg->Overlap = (float)atof(val);
+		else if (!strcmp(arg, "--seed")) cfg->Seed = (uint32_t)strtoul(val, NULL, 10);
+		else if (!strcmp(arg, "--mesh-out")) cfg->MeshOutputPath = val;
+		else if (!strcmp(arg, "--reorder")) cfg->Reorder = atoi(val);
+		else if (!strcmp(arg, "--indexed")) cfg->Indexed = atoi(val) != 0;
+		else if (!strcmp(arg, "--vcache")) cfg->VCache.CacheSize = atoi(val);
+		else if (!strcmp(arg, "--vcache-policy")) cfg->VCache.Replacement = (VCacheReplacement)atoi(val);
+		else if (!strcmp(arg, "--vcache-batch")) cfg->VCache.BatchTris = atoi(val);
+		else if (!strcmp(arg, "--percent")) cfg->MaxNumPixelsPercent = (float)atof(val);
+		else if (!strcmp(arg, "--floats")) cfg->NumFloatsPerVertex = atoi(val);
+		else if (!strcmp(arg, "--format")) cfg->PixelFormatIndex = atoi(val);
+		else if (!strcmp(arg, "--samples")) cfg->SampleCountIndex = atoi(val);
+		else if (!strcmp(arg, "--bin"))
+		{
+			if (sscanf(val, "%dx%d", &cfg->BinWidth, &cfg->BinHeight) != 2 || cfg->BinWidth <= 0 || cfg->BinHeight <= 0)
+			{
+				fprintf(stderr, "Error: invalid bin size %s\n", val);
+				return false;
+			}
+		}
+		else if (!strcmp(arg, "--bin-order")) cfg->BinOrder = atoi(val);
+		else if (!strcmp(arg, "--layout")) cfg->Layout = atoi(val);
+		else if (!strcmp(arg, "--param-buffer")) cfg->ParamBufferKB = std::max(atoi(val), 0);
+		else if (!strcmp(arg, "--threads")) cfg->NumThreads = atoi(val);
+		else if (!strcmp(arg, "--isa")) cfg->ISA = atoi(val);
+		else if (!strcmp(arg, "--job-stats")) cfg->PrintJobStats = atoi(val) != 0;
+		else if (!strcmp(arg, "--frames")) cfg->NumFrames = std::max(atoi(val), 1);
+		else if (!strcmp(arg, "--trace-out")) cfg->TraceOutputPath = val;
+		else if (!strcmp(arg, "--out")) cfg->OutputPath = val;
+		else if (!strcmp(arg, "--order-out")) cfg->OrderOutputPath = val;
+		else if (!strcmp(arg, "--scrub")) cfg->ScrubPercent = (float)atof(val);
+		else if (!strcmp(arg, "--capture-out")) cfg->CaptureOutputPath = val;
+		else if (!strcmp(arg, "--replay")) cfg->ReplayPaths.push_back(val);
+		else if (!strcmp(arg, "--replay-reps")) cfg->ReplayReps = std::max(atoi(val), 1);
+		else if (!strcmp(arg, "--sweep-workloads"))
+		{
+			if (!ParseSweepList(&cfg->SweepWorkloads, arg, val, 0, WORKLOAD_COUNT - 1))
+				return false;
+		}
+		else if (!strcmp(arg, "--sweep-tris"))
+		{
+			if (!ParseSweepList(&cfg->SweepNumTris, arg, val, 0, INT_MAX))
+				return false;
+		}
+		else if (!strcmp(arg, "--sweep-floats"))
+		{
+			if (!ParseSweepList(&cfg->SweepNumFloatsPerVertex, arg, val, 8, 32))
+				return false;
+		}
+		else if (!strcmp(arg, "--sweep-formats"))
+		{
+			if (!ParseSweepList(&cfg->SweepPixelFormatIndices, arg, val, 0, SOFTRAST_FORMAT_COUNT - 1))
+				return false;
+		}
+		else if (!strcmp(arg, "--sweep-samples"))
+		{
+			if (!ParseSweepList(&cfg->SweepSampleCountIndices, arg, val, 0, kSoftRastNumSampleCounts - 1))
+				return false;
+		}
+		else if (!strcmp(arg, "--sweep-out")) cfg->SweepOutputPath = val;
+		else
+		{
+			fprintf(stderr, "Error: unknown option %s\n", arg);
+			return false;
+		}
+
+		i++;
+	}
+
+	if (cfg->Width <= 0 || cfg->Height <= 0)
+	{
+		fprintf(stderr, "Error: invalid size %dx%d\n", cfg->Width, cfg->Height);
+		return false;
+	}
+
+	if (cfg->MaxNumPixelsPercent < 0.0f) cfg->MaxNumPixelsPercent = 0.0f;
+	if (cfg->NumFloatsPerVertex < 8) cfg->NumFloatsPerVertex = 8;
+	if (cfg->NumFloatsPerVertex > 32) cfg->NumFloatsPerVertex = 32;
+
+	if (cfg->PixelFormatIndex < 0 || cfg->PixelFormatIndex >= SOFTRAST_FORMAT_COUNT)
+	{
+		fprintf(stderr, "Error: invalid pixel format index %d\n", cfg->PixelFormatIndex);
+		return false;
+	}
+
+	if (cfg->SampleCountIndex < 0 || cfg->SampleCountIndex >= kSoftRastNumSampleCounts)
+	{
+		fprintf(stderr, "Error: invalid sample count index %d\n", cfg->SampleCountIndex);
+		return false;
+	}
+
+	if (cfg->Workload < 0 || cfg->Workload >= WORKLOAD_COUNT)
+	{
+		fprintf(stderr, "Error: invalid workload %d\n", cfg->Workload);
+		return false;
+	}
+
+	if (cfg->Overlap < 0.0f) cfg->Overlap = 0.0f;
+
+	if (cfg->Reorder < 0 || cfg->Reorder >= MESHOPT_MODE_COUNT)
+	{
+		fprintf(stderr, "Error: invalid reorder mode %d\n", cfg->Reorder);
+		return false;
+	}
+
+	if (cfg->VCache.CacheSize < 1 || cfg->VCache.Replacement < 0 || cfg->VCache.Replacement >= VCACHE_REPLACEMENT_COUNT || cfg->VCache.BatchTris < 0)
+	{
+		fprintf(stderr, "Error: invalid vertex cache %d %d %d\n", cfg->VCache.CacheSize, (int)cfg->VCache.Replacement, cfg->VCache.BatchTris);
+		return false;
+	}
+
+	if (cfg->Layout < 0 || cfg->Layout >= SOFTRAST_LAYOUT_COUNT)
+	{
+		fprintf(stderr, "Error: invalid layout %d\n", cfg->Layout);
+		return false;
+	}
+
+	if (cfg->BinOrder < 0 || cfg->BinOrder >= SOFTRAST_BIN_ORDER_COUNT)
+	{
+		fprintf(stderr, "Error: invalid bin order %d\n", cfg->BinOrder);
+		return false;
+	}
+
+	if (cfg->NumThreads < 0) cfg->NumThreads = 0;
+
+	if (cfg->ISA >= 0 && !SoftRastSetISA((SoftRastISA)cfg->ISA))
+	{
+		fprintf(stderr, "Error: ISA %d is not supported on this CPU (best is %s)\n", cfg->ISA, SoftRastISAName(SoftRastDetectISA()));
+		return false;
+	}
+
+	return true;
+}
+
+static bool WritePPM(const char* path, const uint8_t* rgba, int width, int height)
+{
+	FILE* f = fopen(path, "wb");
+	if (!f)
+	{
+		fprintf(stderr, "Error: could not open %s for writing\n", path);
+		return false;
+	}
+
+	fprintf(f, "P6\n%d %d\n255\n", width, height);
+
+	std::vector<uint8_t> row(width * 3);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			memcpy(&row[x * 3], &rgba[((size_t)y * width + x) * 4], 3);
+		}
+		fwrite(row.data(), 1, row.size(), f);
+	}
+
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+// Order buffer file layout, all little-endian uint32:
+// "TBOB", version (2), width, height, sample count,
+// then width * height * sample count first orders, first triangle IDs, last orders and last triangle IDs,
+// all in SoftRastOrderBuffer's sample order.
+static bool WriteOrderBuffer(const char* path, const SoftRastOrderBuffer* ob)
+{
+	FILE* f = fopen(path, "wb");
+	if (!f)
+	{
+		fprintf(stderr, "Error: could not open %s for writing\n", path);
+		return false;
+	}
+
+	uint32_t header[5] = { 0x424F4254, 2, (uint32_t)ob->Width, (uint32_t)ob->Height, (uint32_t)ob->SampleCount };
+	fwrite(header, sizeof(header), 1, f);
+	fwrite(ob->FirstOrder.data(), sizeof(uint32_t), ob->FirstOrder.size(), f);
+	fwrite(ob->FirstTriangleID.data(), sizeof(uint32_t), ob->FirstTriangleID.size(), f);
+	fwrite(ob->LastOrder.data(), sizeof(uint32_t), ob->LastOrder.size(), f);
+	fwrite(ob->LastTriangleID.data(), sizeof(uint32_t), ob->LastTriangleID.size(), f);
+
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+static void PrintJobsStats()
+{
+	std::vector<JobsWorkerStats> stats;
+	JobsGetStats(&stats);
+
+	printf("job system: %d workers\n", (int)stats.size());
+	printf("  worker       jobs     steals    busy (ms)    idle (ms)\n");
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		printf("  %6d %10llu %10llu %12.3f %12.3f\n", (int)i,
+			(unsigned long long)stats[i].JobsExecuted, (unsigned long long)stats[i].Steals,
+			stats[i].BusySeconds * 1000.0, stats[i].IdleSeconds * 1000.0);
+	}
+}
+
+static bool IsSweep(const HeadlessConfig& cfg)
+{
+	return !cfg.SweepWorkloads.empty() || !cfg.SweepNumTris.empty() || !cfg.SweepNumFloatsPerVertex.empty() ||
+		!cfg.SweepPixelFormatIndices.empty() || !cfg.SweepSampleCountIndices.empty() || cfg.SweepOutputPath;
+}
+
+static SweepConfig GetSweepBase(const HeadlessConfig& cfg, const MeshFile* mesh)
+{
+	SweepConfig base;
+	base.Width = cfg.Width;
+	base.Height = cfg.Height;
+	base.NumTris = cfg.NumTris;
+	base.MaxNumPixelsPercent = cfg.MaxNumPixelsPercent;
+	base.NumFloatsPerVertex = cfg.NumFloatsPerVertex;
+	base.Format = (SoftRastFormat)cfg.PixelFormatIndex;
+	base.SampleCount = kSoftRastSampleCounts[cfg.SampleCountIndex];
+	base.Layout = (SoftRastLayout)cfg.Layout;
+	base.BinWidth = cfg.BinWidth;
+	base.BinHeight = cfg.BinHeight;
+	base.BinOrder = (SoftRastBinOrder)cfg.BinOrder;
+	base.ParamBufferSize = (uint64_t)cfg.ParamBufferKB * 1024;
+	base.Workload = (WorkloadType)cfg.Workload;
+	base.Overlap = cfg.Overlap;
+	base.Seed = cfg.Seed;
+	base.Mesh = mesh;
+	base.Indexed = cfg.Indexed;
+	base.VCache = cfg.VCache;
+	base.MaxNumPixels = cfg.MaxNumPixels;
+	base.CaptureOrder = cfg.CaptureOrder;
+	return base;
+}
+
+// Renders the configurations several at a time, and writes one row per configuration to --sweep-out.
+static int RunConfigs(const HeadlessConfig& cfg, const std::vector<SweepConfig>& configs)
+{
+	FILE* f = stdout;
+	SweepOutputFormat outputFormat = SWEEP_OUTPUT_CSV;
+	if (cfg.SweepOutputPath)
+	{
+		size_t len = strlen(cfg.SweepOutputPath);
+		if (len >= 5 && !strcmp(cfg.SweepOutputPath + len - 5, ".json"))
+			outputFormat = SWEEP_OUTPUT_JSON;
+
+		f = fopen(cfg.SweepOutputPath, "w");
+		if (!f)
+		{
+			fprintf(stderr, "Error: could not open %s for writing\n", cfg.SweepOutputPath);
+			return 1;
+		}
+	}
+
+	JobsInit(cfg.NumThreads);
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	SweepWriter writer;
+	SweepBeginOutput(&writer, f, outputFormat);
+	SweepRun(configs, [&](const SweepResult& result)
+	{
+		SweepWriteResult(&writer, result);
+		if (f != stdout)
+			fprintf(stderr, "\r%d/%d configurations", writer.NumRows, (int)configs.size());
+	});
+	SweepEndOutput(&writer);
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	fprintf(stderr, "%s%d configurations in %.1f s on %d workers\n", f != stdout ? "\n" : "", (int)configs.size(), seconds, JobsGetNumWorkers());
+
+	bool ok = !ferror(f);
+	if (f != stdout)
+		fclose(f);
+
+	if (cfg.PrintJobStats)
+	{
+		PrintJobsStats();
+	}
+
+	if (cfg.TraceOutputPath && !TraceWrite(cfg.TraceOutputPath))
+	{
+		ok = false;
+	}
+
+	return ok ? 0 : 1;
+}
+
+static int RunSweep(const HeadlessConfig& cfg, const MeshFile* mesh)
+{
+	SweepConfig base = GetSweepBase(cfg, mesh);
+
+	SweepAxes axes;
+	for (int i : cfg.SweepWorkloads)
+		axes.Workloads.push_back((WorkloadType)i);
+	axes.NumTris = cfg.SweepNumTris;
+	axes.NumFloatsPerVertex = cfg.SweepNumFloatsPerVertex;
+	for (int i : cfg.SweepPixelFormatIndices)
+		axes.Formats.push_back((SoftRastFormat)i);
+	for (int i : cfg.SweepSampleCountIndices)
+		axes.SampleCounts.push_back(kSoftRastSampleCounts[i]);
+
+	std::vector<SweepConfig> configs = SweepEnumerate(base, axes);
+
+	return RunConfigs(cfg, configs);
+}
+
+// Takes the configuration of the captured frame.
+static void ApplyCapture(HeadlessConfig* cfg, const CaptureFileHeader& header)
+{
+	cfg->Width = (int)header.Width;
+	cfg->Height = (int)header.Height;
+	cfg->PixelFormatIndex = (int)header.PixelFormatIndex;
+	cfg->SampleCountIndex = (int)header.SampleCountIndex;
+	cfg->NumTris = (int)header.NumTris;
+	cfg->NumFloatsPerVertex = (int)header.NumFloatsPerVertex;
+	cfg->MaxNumPixels = header.MaxNumPixels;
+	cfg->Workload = WORKLOAD_HALF_SCREEN;
+	cfg->Indexed = (header.ShaderFlags & CAPTURE_SHADER_INDEXED) != 0;
+	cfg->CaptureOrder = (header.ShaderFlags & CAPTURE_SHADER_ORDER_CAPTURE) != 0;
+}
+
+static int RunReplay(const HeadlessConfig& cfg, const std::vector<CaptureFile>& captures)
+{
+	std::vector<SweepConfig> configs;
+	for (size_t i = 0; i < captures.size(); i++)
+	{
+		HeadlessConfig captureCfg = cfg;
+		ApplyCapture(&captureCfg, *captures[i].Header);
+
+		SweepConfig config = GetSweepBase(captureCfg, captures[i].Mesh.NumTris > 0 ? &captures[i].Mesh : NULL);
+		config.CapturePath = cfg.ReplayPaths[i];
+		configs.insert(configs.end(), cfg.ReplayReps, config);
+	}
+
+	return RunConfigs(cfg, configs);
+}
+
+int main(int argc, char* argv[])
+{
+	HeadlessConfig cfg;
+	if (!ParseArgs(&cfg, argc, argv))
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	if (cfg.TraceOutputPath)
+	{
+		TraceSetEnabled(true);
+	}
+
+	std::vector<CaptureFile> captures(cfg.ReplayPaths.size());
+	for (size_t i = 0; i < captures.size(); i++)
+	{
+		if (!CaptureFileOpen(&captures[i], cfg.ReplayPaths[i]))
+			return 1;
+	}
+
+	if (captures.size() > 1 || (!captures.empty() && cfg.ReplayReps > 1))
+	{
+		return RunReplay(cfg, captures);
+	}
+
+	MeshFile mesh;
+	if (captures.size() == 1)
+	{
+		// a single replay draws one image, as without a capture, with the capture's geometry as the mesh
+		ApplyCapture(&cfg, *captures[0].Header);
+		mesh = captures[0].Mesh;
+		cfg.MeshPath = mesh.NumTris > 0 ? cfg.ReplayPaths[0] : NULL;
+	}
+	else if (cfg.MeshPath)
+	{
+		if (!MeshFileOpen(&mesh, cfg.MeshPath))
+			return 1;
+
+		if (cfg.NumTris < 0 || cfg.NumTris > (int)mesh.NumTris)
+			cfg.NumTris = (int)mesh.NumTris;
+	}
+	else if (cfg.NumTris < 0)
+	{
+		cfg.NumTris = 0;
+	}
+
+	// the scrub guesses the triangle of a pixel from its first and last orders, which is only exact for the half-screen triangle
+	if (cfg.ScrubPercent >= 0.0f && (cfg.MeshPath || cfg.Workload != WORKLOAD_HALF_SCREEN))
+	{
+		fprintf(stderr, "Error: --scrub only supports the half-screen triangle, not meshes or workloads\n");
+		return 1;
+	}
+
+	if (IsSweep(cfg))
+	{
+		return RunSweep(cfg, cfg.MeshPath ? &mesh : NULL);
+	}
+
+	SoftRastFormat format = (SoftRastFormat)cfg.PixelFormatIndex;
+	int sampleCount = kSoftRastSampleCounts[cfg.SampleCountIndex];
+
+	SoftRastTarget trianglesMS;
+	SoftRastTarget triangles;
+	SoftRastResize(&trianglesMS, cfg.Width, cfg.Height, format, sampleCount, (SoftRastLayout)cfg.Layout);
+	SoftRastResize(&triangles, cfg.Width, cfg.Height, format, 1);
+
+	JobsInit(cfg.NumThreads);
+
+	SoftRastDrawParams params;
+	params.NumTris = cfg.NumTris;
+	if (cfg.MeshPath)
+	{
+		params.MeshPositions = mesh.Positions;
+		params.MeshNumVertices = mesh.NumVertices;
+		params.MeshIndices = mesh.Indices;
+	}
+
+	Workload workload;
+	double workloadMs = 0.0;
+	if (!cfg.MeshPath && cfg.Workload != WORKLOAD_HALF_SCREEN)
+	{
+		WorkloadParams workloadParams;
+		workloadParams.Type = (WorkloadType)cfg.Workload;
+		workloadParams.NumTris = cfg.NumTris;
+		workloadParams.Overlap = cfg.Overlap;
+		workloadParams.Seed = cfg.Seed;
+
+		auto workloadStart = std::chrono::high_resolution_clock::now();
+		WorkloadGenerate(&workload, workloadParams);
+		workloadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - workloadStart).count();
+
+		params.MeshPositions = workload.Positions.get();
+		params.MeshNumVertices = workload.NumVertices;
+		params.MeshIndices = workload.Indices.get();
+	}
+
+	std::vector<uint32_t> reorderedIndices;
+	MeshOptParams meshOptParams;
+	MeshOptStats meshOptStatsBefore;
+	MeshOptStats meshOptStatsAfter;
+	double reorderMs = 0.0;
+	if (params.MeshIndices && cfg.Reorder != MESHOPT_NONE)
+	{
+		meshOptParams.Mode = (MeshOptMode)cfg.Reorder;
+		meshOptParams.CacheSize = cfg.VCache.CacheSize;
+		meshOptParams.Width = cfg.Width;
+		meshOptParams.Height = cfg.Height;
+		if (cfg.BinWidth > 0)
+		{
+			meshOptParams.BinWidth = cfg.BinWidth;
+			meshOptParams.BinHeight = cfg.BinHeight;
+		}
+
+		MeshOptAnalyze(&meshOptStatsBefore, params.MeshIndices, (uint32_t)params.NumTris, params.MeshPositions, params.MeshNumVertices, meshOptParams, cfg.VCache);
+
+		auto reorderStart = std::chrono::high_resolution_clock::now();
+		reorderedIndices.resize((size_t)params.NumTris * 3);
+		MeshOptReorder(reorderedIndices.data(), params.MeshIndices, (uint32_t)params.NumTris, params.MeshPositions, params.MeshNumVertices, meshOptParams);
+		reorderMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - reorderStart).count();
+		params.MeshIndices = reorderedIndices.data();
+
+		MeshOptAnalyze(&meshOptStatsAfter, params.MeshIndices, (uint32_t)params.NumTris, params.MeshPositions, params.MeshNumVertices, meshOptParams, cfg.VCache);
+	}
+
+	if (params.MeshIndices && cfg.MeshOutputPath &&
+		!MeshFileWrite(cfg.MeshOutputPath, params.MeshPositions, params.MeshNumVertices, params.MeshIndices, (uint32_t)params.NumTris))
+	{
+		return 1;
+	}
+	params.MeshIndexed = cfg.Indexed && params.MeshIndices;
+	params.NumFloatsPerVertex = cfg.NumFloatsPerVertex;
+	params.MaxNumPixels = cfg.MaxNumPixels >= 0 ? (uint32_t)cfg.MaxNumPixels : SoftRastMaxNumPixels(cfg.MaxNumPixelsPercent, cfg.Width, cfg.Height, cfg.NumTris);
+
+	VCacheStats vcacheStats;
+	if (params.MeshIndices)
+	{
+		VCacheSimulate(&vcacheStats, params.MeshIndices, (uint32_t)params.NumTris, params.MeshNumVertices, cfg.VCache);
+		params.MeshVSInvocations = vcacheStats.VertexShaderInvocations;
+	}
+	params.BinWidth = cfg.BinWidth;
+	params.BinHeight = cfg.BinHeight;
+	params.BinOrder = (SoftRastBinOrder)cfg.BinOrder;
+	params.ParamBufferSize = (uint64_t)cfg.ParamBufferKB * 1024;
+	SoftRastParamBufferStats paramBufferStats;
+	params.ParamBufferStats = &paramBufferStats;
+	SoftRastPipelineStats pipelineStats;
+	params.PipelineStats = &pipelineStats;
+
+	SoftRastOrderBuffer orderBuffer;
+	if (cfg.OrderOutputPath || cfg.ScrubPercent >= 0.0f || cfg.CaptureOrder)
+	{
+		SoftRastResizeOrderBuffer(&orderBuffer, cfg.Width, cfg.Height, sampleCount);
+		params.OrderBuffer = &orderBuffer;
+	}
+
+	const float kClearColor[] = { 0, 0, 0, 0 };
+	SoftRastRasterStats rasterStats;
+	uint32_t pixelCounter = 0;
+	std::vector<uint8_t> backbuffer((size_t)cfg.Width * cfg.Height * 4);
+	double ms = 0.0;
+
+	// the frames' pixel counters are consumed as the Toolbox consumes the GPU's, through a readback ring
+	ReadbackRing readback;
+	ReadbackInit(&readback, kReadbackDefaultDepth);
+	ReadbackResult readbackResult;
+	int numFramesReadBack = 0;
+
+	// the frames are identical, the statistics and frame time printed are the last one's
+	for (int frameIndex = 0; frameIndex < cfg.NumFrames; frameIndex++)
+	{
+		bool lastFrame = frameIndex == cfg.NumFrames - 1;
+		TimingFrame frame;
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		{
+			TimingScope timing(&frame, TIMING_PASS_CLEAR);
+			SoftRastClear(&trianglesMS, kClearColor);
+			// the first frame's is cleared by SoftRastResizeOrderBuffer
+			if (params.OrderBuffer && frameIndex > 0)
+				SoftRastClearOrderBuffer(&orderBuffer);
+		}
+		{
+			TimingScope timing(&frame, TIMING_PASS_TRIANGLES);
+			pixelCounter = SoftRastDraw(&trianglesMS, params, lastFrame ? &rasterStats : NULL);
+		}
+		{
+			TimingScope timing(&frame, TIMING_PASS_RESOLVE);
+			SoftRastResolve(&triangles, &trianglesMS);
+		}
+		{
+			TimingScope timing(&frame, TIMING_PASS_BLIT);
+			SoftRastBlit(backbuffer.data(), cfg.Width * 4, &triangles);
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+		TimingPushFrame(frame);
+
+		ReadbackIssueCPU(&readback, (uint64_t)frameIndex, pixelCounter, params.MaxNumPixels, NULL);
+		while (ReadbackPoll(&readback, &readbackResult))
+			numFramesReadBack++;
+	}
+
+	double scrubMs = 0.0;
+	if (cfg.ScrubPercent >= 0.0f)
+	{
+		auto scrubStart = std::chrono::high_resolution_clock::now();
+
+		SoftRastDrawParams scrubParams = params;
+		scrubParams.MaxNumPixels = SoftRastMaxNumPixels(cfg.ScrubPercent, cfg.Width, cfg.Height, cfg.NumTris);
+		SoftRastThresholdOrderBuffer(&trianglesMS, scrubParams, &orderBuffer, kClearColor);
+		SoftRastResolve(&triangles, &trianglesMS);
+		SoftRastBlit(backbuffer.data(), cfg.Width * 4, &triangles);
+
+		scrubMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - scrubStart).count();
+	}
+
+	printf("%dx%d %s x%d, %d tris, %d floats per vertex, max %u pixels\n",
+		cfg.Width, cfg.Height, SoftRastFormatName(format), sampleCount,
+		cfg.NumTris, cfg.NumFloatsPerVertex, params.MaxNumPixels);
+	if (cfg.MeshPath)
+		printf("mesh: %s, %u vertices, %u triangles\n", cfg.MeshPath, mesh.NumVertices, mesh.NumTris);
+	else if (cfg.Workload != WORKLOAD_HALF_SCREEN)
+		printf("workload: %s, overlap %g, seed %u, %u vertices, generated in %.3f ms (%.2f GB/s)\n",
+			WorkloadTypeName((WorkloadType)cfg.Workload), cfg.Overlap, cfg.Seed, workload.NumVertices, workloadMs,
+			((double)workload.NumVertices * 4 * sizeof(float) + (double)workload.NumTris * 3 * sizeof(uint32_t)) / (workloadMs * 1e6));
+	if (params.MeshIndices)
+	{
+		printf("%s draw, vertex cache: %s %d", params.MeshIndexed ? "indexed" : "non-indexed",
+			VCacheReplacementName(cfg.VCache.Replacement), cfg.VCache.CacheSize);
+		if (cfg.VCache.BatchTris > 0)
+			printf(", batches of %d triangles", cfg.VCache.BatchTris);
+		printf("\n");
+		printf("  ACMR %.3f, ATVR %.3f, %llu unique vertices, %llu vertex shader invocations indexed, %llu saved (%.1f MB of vertex outputs)\n",
+			vcacheStats.ACMR, vcacheStats.ATVR, (unsigned long long)vcacheStats.NumUniqueVertices,
+			(unsigned long long)vcacheStats.VertexShaderInvocations, (unsigned long long)vcacheStats.VertexShaderInvocationsSaved,
+			(double)vcacheStats.VertexShaderInvocationsSaved * cfg.NumFloatsPerVertex * sizeof(float) / (1024.0 * 1024.0));
+	}
+	if (params.MeshIndices && cfg.Reorder != MESHOPT_NONE)
+	{
+		printf("reordered (%s, %dx%d bins) in %.3f ms\n", MeshOptModeName(meshOptParams.Mode), meshOptParams.BinWidth, meshOptParams.BinHeight, reorderMs);
+		printf("              ACMR  bin switches per bin  centroid distance (pixels)\n");
+		printf("  before  %8.3f  %20.1f  %26.1f\n", meshOptStatsBefore.VCache.ACMR, meshOptStatsBefore.BinSwitchesPerBin, meshOptStatsBefore.MeanCentroidDistance);
+		printf("  after   %8.3f  %20.1f  %26.1f\n", meshOptStatsAfter.VCache.ACMR, meshOptStatsAfter.BinSwitchesPerBin, meshOptStatsAfter.MeanCentroidDistance);
+	}
+	printf("kernels: %s, %s layout\n", SoftRastISAName(SoftRastGetISA()), SoftRastLayoutName(trianglesMS.Layout));
+	if (params.BinWidth > 0)
+	{
+		printf("binned: %dx%d bins, %s order\n", params.BinWidth, params.BinHeight, SoftRastBinOrderName(params.BinOrder));
+		if (cfg.ParamBufferKB > 0)
+			printf("parameter buffer: %d KB, %llu flushes", cfg.ParamBufferKB, (unsigned long long)paramBufferStats.Flushes);
+		else
+			printf("parameter buffer: unlimited");
+		printf(", peak %.1f KB, %.1f KB stored, per bin %.1f KB mean, %.1f KB max\n",
+			paramBufferStats.PeakBytes / 1024.0, paramBufferStats.TotalBytes / 1024.0,
+			paramBufferStats.MeanBinBytes / 1024.0, paramBufferStats.MaxBinBytes / 1024.0);
+	}
+	else
+		printf("immediate mode\n");
+	printf("pixel shader invocations: %u, %u shaded (frames read back: %d)\n", readbackResult.PixelCounter, readbackResult.PixelsShaded, numFramesReadBack);
+	printf("pipeline statistics: %llu VS invocations, %llu primitives, %llu PS invocations (%llu discarded), %llu samples written (%.1f MB, %d bytes per sample)\n",
+		(unsigned long long)pipelineStats.VSInvocations, (unsigned long long)pipelineStats.Primitives,
+		(unsigned long long)pipelineStats.PSInvocations, (unsigned long long)pipelineStats.PSInvocationsDiscarded,
+		(unsigned long long)pipelineStats.SamplesWritten, pipelineStats.BytesWritten / (1024.0 * 1024.0), SoftRastBytesPerSample(format));
+	printf("coarse tiles: %llu accepted, %llu rejected, %llu partial\n",
+		(unsigned long long)rasterStats.TilesAccepted, (unsigned long long)rasterStats.TilesRejected, (unsigned long long)rasterStats.TilesPartial);
+	printf("8x8 blocks: %llu accepted, %llu rejected, %llu partial\n",
+		(unsigned long long)rasterStats.BlocksAccepted, (unsigned long long)rasterStats.BlocksRejected, (unsigned long long)rasterStats.BlocksPartial);
+	printf("frame time: %.3f ms\n", ms);
+	if (cfg.NumFrames > 1)
+	{
+		TimingPercentiles percentiles[TIMING_PASS_COUNT];
+		TimingGetPercentiles(percentiles, cfg.NumFrames);
+
+		printf("pass times over the last %d frames:\n", std::min(cfg.NumFrames, kTimingMaxFrames));
+		printf("  pass        p50 (ms)  p99 (ms)\n");
+		for (int pass = 0; pass < TIMING_PASS_COUNT; pass++)
+		{
+			if (percentiles[pass].NumFrames > 0)
+				printf("  %-10s  %8.3f  %8.3f\n", TimingPassName((TimingPass)pass), percentiles[pass].P50Ms, percentiles[pass].P99Ms);
+		}
+	}
+	if (cfg.ScrubPercent >= 0.0f)
+		printf("scrub to %g: %.3f ms\n", cfg.ScrubPercent, scrubMs);
+
+	if (cfg.PrintJobStats)
+	{
+		PrintJobsStats();
+	}
+
+	if (cfg.OutputPath)
+	{
+		TraceScope trace("export");
+		if (!WritePPM(cfg.OutputPath, backbuffer.data(), cfg.Width, cfg.Height))
+			return 1;
+	}
+
+	if (cfg.OrderOutputPath && !WriteOrderBuffer(cfg.OrderOutputPath, &orderBuffer))
+	{
+		return 1;
+	}
+
+	if (cfg.CaptureOutputPath)
+	{
+		CaptureFileHeader header = {};
+		header.Width = (uint32_t)cfg.Width;
+		header.Height = (uint32_t)cfg.Height;
+		header.PixelFormatIndex = (uint32_t)cfg.PixelFormatIndex;
+		header.SampleCountIndex = (uint32_t)cfg.SampleCountIndex;
+		header.NumTris = (uint32_t)params.NumTris;
+		header.NumFloatsPerVertex = (uint32_t)cfg.NumFloatsPerVertex;
+		header.MaxNumPixels = params.MaxNumPixels;
+		header.ShaderFlags = (params.MeshIndices ? CAPTURE_SHADER_MESH : 0) | (params.MeshIndexed ? CAPTURE_SHADER_INDEXED : 0) |
+			(cfg.CaptureOrder ? CAPTURE_SHADER_ORDER_CAPTURE : 0);
+		header.NumVertices = params.MeshIndices ? params.MeshNumVertices : 0;
+		if (!CaptureFileWrite(cfg.CaptureOutputPath, header, params.MeshPositions, params.MeshIndices))
+			return 1;
+	}
+
+	if (cfg.TraceOutputPath && !TraceWrite(cfg.TraceOutputPath))
+	{
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,397 @@
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+struct JobGroup
+{
+	const std::function<void(int)>* Func;
+
+	// jobs not finished yet
+	std::atomic<int> Remaining;
+
+	// the job that started the group, identified by its group and first index, NULL at the top level.
+	// Ancestors stay alive while the group runs, since they're waiting for it.
+	const JobGroup* ParentGroup;
+	int ParentBegin;
+};
+
+struct Job
+{
+	JobGroup* Group;
+	int Begin;
+	int End;
+};
+
+struct JobsWorker
+{
+	std::mutex Mutex;
+	std::deque<Job> Jobs;
+	std::thread Thread;
+
+	std::atomic<uint64_t> JobsExecuted;
+	std::atomic<uint64_t> Steals;
+	std::atomic<uint64_t> BusyNanoseconds;
+	std::atomic<uint64_t> IdleNanoseconds;
+};
+
+static std::mutex g_InitMutex;
+static std::atomic<bool> g_Initialized;
+static std::vector<std::unique_ptr<JobsWorker>> g_Workers;
+
+// jobs sitting in a deque, used by idle workers to decide when to go to sleep
+static std::atomic<int> g_NumQueuedJobs;
+static std::atomic<bool> g_ShuttingDown;
+static std::mutex g_SleepMutex;
+static std::condition_variable g_SleepCV;
+
+// jobs pushed by threads that aren't workers are spread over the workers
+static std::atomic<unsigned> g_NextExternalWorker;
+
+static thread_local int t_WorkerIndex = -1;
+// time the current job spent running nested jobs and waiting for them, already counted, excluded from its busy time
+static thread_local uint64_t t_NestedNanoseconds;
+// the job the thread is running, NULL if none
+static thread_local const Job* t_CurrentJob;
+// see JobsGetForeignNanoseconds
+static thread_local uint64_t t_ForeignNanoseconds;
+
+struct JobsAutoShutdown
+{
+	~JobsAutoShutdown() { JobsShutdown(); }
+};
+static JobsAutoShutdown g_AutoShutdown;
+
+static uint64_t NowNanoseconds()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool PopLocal(int workerIndex, Job* job)
+{
+	JobsWorker* worker = g_Workers[workerIndex].get();
+	std::lock_guard<std::mutex> lock(worker->Mutex);
+	if (worker->Jobs.empty())
+		return false;
+
+	*job = worker->Jobs.back();
+	worker->Jobs.pop_back();
+	g_NumQueuedJobs--;
+	return true;
+}
+
+// Steals half of the jobs at the front of another worker's deque.
+// One of them is returned and the others go to the back of the thief's deque.
+// Threads that aren't workers only steal the one job they run.
+static bool Steal(int thiefIndex, Job* job)
+{
+	int numWorkers = (int)g_Workers.size();
+	int start = thiefIndex >= 0 ? thiefIndex + 1 : (int)(g_NextExternalWorker.load() % numWorkers);
+
+	Job stolen[32];
+	int numStolen = 0;
+
+	for (int i = 0; i < numWorkers && numStolen == 0; i++)
+	{
+		int victimIndex = (start + i) % numWorkers;
+		if (victimIndex == thiefIndex)
+			continue;
+
+		JobsWorker* victim = g_Workers[victimIndex].get();
+		std::lock_guard<std::mutex> lock(victim->Mutex);
+
+		int available = (int)victim->Jobs.size();
+		int wanted = thiefIndex >= 0 ? std::min((available + 1) / 2, (int)(sizeof(stolen) / sizeof(*stolen))) : std::min(available, 1);
+		for (; numStolen < wanted; numStolen++)
+		{
+			stolen[numStolen] = victim->Jobs.front();
+			victim->Jobs.pop_front();
+		}
+	}
+
+	if (numStolen == 0)
+		return false;
+
+	*job = stolen[0];
+	g_NumQueuedJobs--;
+
+	if (thiefIndex >= 0)
+	{
+		JobsWorker* thief = g_Workers[thiefIndex].get();
+		thief->Steals++;
+
+		if (numStolen > 1)
+		{
+			// keep the order they had at the victim: the next one to run goes last
+			std::lock_guard<std::mutex> lock(thief->Mutex);
+			for (int i = numStolen - 1; i >= 1; i--)
+			{
+				thief->Jobs.push_back(stolen[i]);
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool FindJob(int workerIndex, Job* job)
+{
+	if (workerIndex >= 0 && PopLocal(workerIndex, job))
+		return true;
+
+	return Steal(workerIndex, job);
+}
+
+// Whether job was started, directly or not, by ancestor.
+static bool IsDescendant(const Job& job, const Job* ancestor)
+{
+	for (const JobGroup* group = job.Group; group; group = group->ParentGroup)
+	{
+		if (group->ParentGroup == ancestor->Group && group->ParentBegin == ancestor->Begin)
+			return true;
+	}
+	return false;
+}
+
+static void RunJob(int workerIndex, const Job& job)
+{
+	uint64_t start = workerIndex >= 0 ? NowNanoseconds() : 0;
+	uint64_t outerNested = t_NestedNanoseconds;
+	t_NestedNanoseconds = 0;
+	const Job* outerJob = t_CurrentJob;
+	t_CurrentJob = &job;
+
+	for (int i = job.Begin; i < job.End; i++)
+	{
+		(*job.Group->Func)(i);
+	}
+
+	t_CurrentJob = outerJob;
+
+	if (workerIndex >= 0)
+	{
+		uint64_t elapsed = NowNanoseconds() - start;
+		JobsWorker* worker = g_Workers[workerIndex].get();
+		worker->JobsExecuted++;
+		worker->BusyNanoseconds += elapsed - std::min(t_NestedNanoseconds, elapsed);
+		// excluded from the job this one is nested in, if any
+		t_NestedNanoseconds = outerNested + elapsed;
+	}
+	else
+	{
+		t_NestedNanoseconds = outerNested;
+	}
+
+	// last, since the group is on the stack of the thread waiting for it
+	job.Group->Remaining--;
+}
+
+static void WorkerMain(int workerIndex)
+{
+	t_WorkerIndex = workerIndex;
+	JobsWorker* worker = g_Workers[workerIndex].get();
+
+	while (!g_ShuttingDown)
+	{
+		Job job;
+		if (FindJob(workerIndex, &job))
+		{
+			RunJob(workerIndex, job);
+			continue;
+		}
+
+		uint64_t idleStart = NowNanoseconds();
+		{
+			std::unique_lock<std::mutex> lock(g_SleepMutex);
+			g_SleepCV.wait(lock, [] { return g_NumQueuedJobs > 0 || g_ShuttingDown; });
+		}
+		worker->IdleNanoseconds += NowNanoseconds() - idleStart;
+	}
+}
+
+void JobsInit(int numWorkers)
+{
+	std::lock_guard<std::mutex> lock(g_InitMutex);
+	if (g_Initialized)
+		return;
+
+	if (numWorkers <= 0)
+		numWorkers = (int)std::max(std::thread::hardware_concurrency(), 1u);
+
+	g_ShuttingDown = false;
+	g_NumQueuedJobs = 0;
+
+	for (int i = 0; i < numWorkers; i++)
+	{
+		g_Workers.emplace_back(new JobsWorker());
+	}
+
+	t_WorkerIndex = 0;
+	for (int i = 1; i < numWorkers; i++)
+	{
+		g_Workers[i]->Thread = std::thread(WorkerMain, i);
+	}
+
+	JobsResetStats();
+
+	g_Initialized = true;
+}
+
+void JobsShutdown()
+{
+	std::lock_guard<std::mutex> lock(g_InitMutex);
+	if (!g_Initialized)
+		return;
+
+	{
+		std::lock_guard<std::mutex> sleepLock(g_SleepMutex);
+		g_ShuttingDown = true;
+	}
+	g_SleepCV.notify_all();
+
+	for (std::unique_ptr<JobsWorker>& worker : g_Workers)
+	{
+		if (worker->Thread.joinable())
+			worker->Thread.join();
+	}
+
+	g_Workers.clear();
+	t_WorkerIndex = -1;
+	g_Initialized = false;
+}
+
+int JobsGetNumWorkers()
+{
+	return (int)g_Workers.size();
+}
+
+int JobsGetWorkerIndex()
+{
+	return t_WorkerIndex;
+}
+
+void JobsParallelFor(int count, int grainSize, const std::function<void(int)>& func)
+{
+	if (count <= 0)
+		return;
+
+	if (!g_Initialized)
+		JobsInit(0);
+
+	if (grainSize < 1)
+		grainSize = 1;
+
+	int workerIndex = t_WorkerIndex;
+	int numJobs = (count + grainSize - 1) / grainSize;
+
+	JobGroup group;
+	group.Func = &func;
+	group.ParentGroup = t_CurrentJob ? t_CurrentJob->Group : NULL;
+	group.ParentBegin = t_CurrentJob ? t_CurrentJob->Begin : 0;
+
+	if (g_Workers.size() == 1 || numJobs == 1)
+	{
+		group.Remaining = 1;
+
+		Job job;
+		job.Group = &group;
+		job.Begin = 0;
+		job.End = count;
+		RunJob(workerIndex, job);
+		return;
+	}
+
+	group.Remaining = numJobs;
+
+	int targetIndex = workerIndex >= 0 ? workerIndex : (int)(g_NextExternalWorker++ % g_Workers.size());
+	JobsWorker* target = g_Workers[targetIndex].get();
+	{
+		// pushed in reverse, so that popping from the back starts with the first indices
+		std::lock_guard<std::mutex> lock(target->Mutex);
+		for (int j = numJobs - 1; j >= 0; j--)
+		{
+			Job job;
+			job.Group = &group;
+			job.Begin = j * grainSize;
+			job.End = std::min(job.Begin + grainSize, count);
+			target->Jobs.push_back(job);
+		}
+		g_NumQueuedJobs += numJobs;
+	}
+
+	{
+		std::lock_guard<std::mutex> sleepLock(g_SleepMutex);
+	}
+	g_SleepCV.notify_all();
+
+	// help out while waiting, which also runs jobs of other groups if ours were all stolen.
+	// The jobs run count as busy time, the rest of the wait as idle time, and neither as busy time of the job waiting, if any.
+	uint64_t waitStart = workerIndex >= 0 ? NowNanoseconds() : 0;
+	uint64_t nestedBefore = t_NestedNanoseconds;
+	while (group.Remaining > 0)
+	{
+		Job job;
+		if (FindJob(workerIndex, &job))
+		{
+			if (!t_CurrentJob || IsDescendant(job, t_CurrentJob))
+			{
+				RunJob(workerIndex, job);
+				continue;
+			}
+
+			// the time of the unrelated job replaces what it counted itself as foreign
+			uint64_t foreignStart = NowNanoseconds();
+			uint64_t outerForeign = t_ForeignNanoseconds;
+			RunJob(workerIndex, job);
+			t_ForeignNanoseconds = outerForeign + (NowNanoseconds() - foreignStart);
+			continue;
+		}
+
+		std::this_thread::yield();
+	}
+
+	if (workerIndex >= 0)
+	{
+		uint64_t waited = NowNanoseconds() - waitStart;
+		uint64_t ran = t_NestedNanoseconds - nestedBefore;
+		g_Workers[workerIndex]->IdleNanoseconds += waited - std::min(ran, waited);
+		t_NestedNanoseconds = nestedBefore + waited;
+	}
+}
+
+uint64_t JobsGetForeignNanoseconds()
+{
+	return t_ForeignNanoseconds;
+}
+
+void JobsGetStats(std::vector<JobsWorkerStats>* stats)
+{
+	stats->resize(g_Workers.size());
+	for (size_t i = 0; i < g_Workers.size(); i++)
+	{
+		const JobsWorker* worker = g_Workers[i].get();
+		JobsWorkerStats& s = (*stats)[i];
+		s.JobsExecuted = worker->JobsExecuted;
+		s.Steals = worker->Steals;
+		s.BusySeconds = (double)worker->BusyNanoseconds * 1e-9;
+		s.IdleSeconds = (double)worker->IdleNanoseconds * 1e-9;
+	}
+}
+
+void JobsResetStats()
+{
+	for (std::unique_ptr<JobsWorker>& worker : g_Workers)
+	{
+		worker->JobsExecuted = 0;
+		worker->Steals = 0;
+		worker->BusyNanoseconds = 0;
+		worker->IdleNanoseconds = 0;
+	}
+}
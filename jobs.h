@@ -0,0 +1,39 @@
+#pragma once
+
+// Work-stealing job system.
+// Each worker owns a deque of jobs: it pushes and pops at the back, and idle workers steal half of the jobs at the front of another worker's deque.
+// Threads waiting for their jobs to finish run other jobs in the meantime, so parallel loops can be nested.
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct JobsWorkerStats
+{
+	uint64_t JobsExecuted;
+	uint64_t Steals;
+
+	// time spent running jobs, and time spent looking for or waiting for jobs. A job waiting for the jobs it started
+	// isn't busy meanwhile: the jobs run in the meantime count once, and the rest of the wait is idle.
+	double BusySeconds;
+	double IdleSeconds;
+};
+
+// Starts the workers. The calling thread becomes worker 0, numWorkers - 1 threads are created for the others.
+// numWorkers = 0 uses all cores. If JobsInit isn't called, the first JobsParallelFor does it with all cores.
+void JobsInit(int numWorkers);
+void JobsShutdown();
+int JobsGetNumWorkers();
+// -1 on threads that aren't workers.
+int JobsGetWorkerIndex();
+
+// Calls func(i) for i in [0, count), in parallel, and returns once all calls are done.
+// Indices are split into jobs of grainSize consecutive indices. The calling thread's jobs are started in index order.
+void JobsParallelFor(int count, int grainSize, const std::function<void(int)>& func);
+
+// Time the calling thread has spent, while waiting in JobsParallelFor inside a job, running jobs that weren't started by that job.
+// Subtracting its increase from a job's elapsed time leaves the time of the job's own work and of the jobs it waited for.
+uint64_t JobsGetForeignNanoseconds();
+
+void JobsGetStats(std::vector<JobsWorkerStats>* stats);
+void JobsResetStats();
@@ -2,6 +2,7 @@
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_dx11.h"
 #include "scene.h"
+#include "gputiming.h"
 
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "dxgi.lib")
@@ -177,13 +178,20 @@ void RendererPaint()
 	CHECKHR(sc->GetBuffer(0, IID_PPV_ARGS(&pBackBufferTex2D)));
 	CHECKHR(dev->CreateRenderTargetView(pBackBufferTex2D.Get(), &g_SwapChainRTVDesc, &pBackBufferRTV));
 
+	GpuTimingBeginFrame();
+
 	ScenePaint(pBackBufferRTV.Get());
 
 	// Render ImGui
-	ID3D11RenderTargetView* imguiRTVs[] = { pBackBufferRTV.Get() };
-	dc->OMSetRenderTargets(_countof(imguiRTVs), imguiRTVs, NULL);
-	ImGui::Render();
-	dc->OMSetRenderTargets(0, NULL, NULL);
+	{
+		GpuTimingScope timing(TIMING_PASS_IMGUI);
+		ID3D11RenderTargetView* imguiRTVs[] = { pBackBufferRTV.Get() };
+		dc->OMSetRenderTargets(_countof(imguiRTVs), imguiRTVs, NULL);
+		ImGui::Render();
+		dc->OMSetRenderTargets(0, NULL, NULL);
+	}
+
+	GpuTimingEndFrame();
 
 	// finally present
 	CHECKHR(sc->Present(0, 0));
@@ -0,0 +1,156 @@
+#include "mesh.h"
+
+#include <cstdio>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFileOpen(MappedFile* file, const char* path)
+{
+	*file = MappedFile();
+
+#if defined(_WIN32)
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+
+	const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file->FileHandle = handle;
+	file->MappingHandle = mapping;
+	file->Data = data;
+	file->Size = (size_t)size.QuadPart;
+	return true;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// the mapping keeps the file alive
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return false;
+
+	file->Data = data;
+	file->Size = (size_t)st.st_size;
+	return true;
+#endif
+}
+
+void MappedFileClose(MappedFile* file)
+{
+#if defined(_WIN32)
+	if (file->Data) UnmapViewOfFile(file->Data);
+	if (file->MappingHandle) CloseHandle(file->MappingHandle);
+	if (file->FileHandle) CloseHandle(file->FileHandle);
+#else
+	if (file->Data) munmap((void*)file->Data, file->Size);
+#endif
+
+	*file = MappedFile();
+}
+
+bool MeshFileOpen(MeshFile* mesh, const char* path)
+{
+	*mesh = MeshFile();
+
+	if (!MappedFileOpen(&mesh->Mapping, path))
+	{
+		fprintf(stderr, "Error: could not map %s\n", path);
+		return false;
+	}
+
+	const MeshFileHeader* header = (const MeshFileHeader*)mesh->Mapping.Data;
+	if (mesh->Mapping.Size < sizeof(MeshFileHeader) || header->Magic != kMeshFileMagic || header->Version != kMeshFileVersion)
+	{
+		fprintf(stderr, "Error: %s is not a version %u mesh file\n", path, kMeshFileVersion);
+		MeshFileClose(mesh);
+		return false;
+	}
+
+	size_t positionsSize = (size_t)header->NumVertices * 4 * sizeof(float);
+	size_t indicesSize = (size_t)header->NumTris * 3 * sizeof(uint32_t);
+	if (mesh->Mapping.Size != sizeof(MeshFileHeader) + positionsSize + indicesSize)
+	{
+		fprintf(stderr, "Error: %s has %zu bytes, %u vertices and %u triangles need %zu\n",
+			path, mesh->Mapping.Size, header->NumVertices, header->NumTris, sizeof(MeshFileHeader) + positionsSize + indicesSize);
+		MeshFileClose(mesh);
+		return false;
+	}
+
+	const uint8_t* data = (const uint8_t*)mesh->Mapping.Data;
+	mesh->Positions = (const float*)(data + sizeof(MeshFileHeader));
+	mesh->Indices = (const uint32_t*)(data + sizeof(MeshFileHeader) + positionsSize);
+	mesh->NumVertices = header->NumVertices;
+	mesh->NumTris = header->NumTris;
+	return true;
+}
+
+void MeshFileClose(MeshFile* mesh)
+{
+	MappedFileClose(&mesh->Mapping);
+	*mesh = MeshFile();
+}
+
+bool MeshFileWrite(const char* path, const float* positions, uint32_t numVertices, const uint32_t* indices, uint32_t numTris)
+{
+	FILE* f = fopen(path, "wb");
+	if (!f)
+	{
+		fprintf(stderr, "Error: could not open %s for writing\n", path);
+		return false;
+	}
+
+	MeshFileHeader header = {};
+	header.Magic = kMeshFileMagic;
+	header.Version = kMeshFileVersion;
+	header.NumVertices = numVertices;
+	header.NumTris = numTris;
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(positions, 4 * sizeof(float), numVertices, f);
+	fwrite(indices, 3 * sizeof(uint32_t), numTris, f);
+
+	bool ok = !ferror(f);
+	fclose(f);
+	if (!ok)
+		fprintf(stderr, "Error: could not write %s\n", path);
+	return ok;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// Triangle meshes drawn instead of the half-screen triangle, e.g. geometry captured from a game.
+//
+// Mesh files are memory-mapped and used in place, so opening one doesn't read, parse or copy it.
+// Layout, all little-endian:
+// MeshFileHeader (32 bytes),
+// then NumVertices clip space positions (float4, the SV_Position output of the captured vertex shader),
+// then NumTris * 3 uint32 indices into the positions, 3 per triangle.
+// Triangles are clockwise front faces, as in triangles.hlsl.
+// Indices aren't validated: out of range ones read a (0,0,0,0) position on both the CPU and the GPU.
+
+#include <cstddef>
+#include <cstdint>
+
+// "TBMS"
+static const uint32_t kMeshFileMagic = 0x534D4254;
+static const uint32_t kMeshFileVersion = 1;
+
+struct MeshFileHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t NumVertices;
+	uint32_t NumTris;
+	// keeps the positions 16-byte aligned
+	uint32_t Reserved[4];
+};
+
+// Read-only memory mapping of a whole file, also used by capture files (see capture.h).
+struct MappedFile
+{
+	const void* Data = NULL;
+	size_t Size = 0;
+#if defined(_WIN32)
+	void* FileHandle = NULL;
+	void* MappingHandle = NULL;
+#endif
+};
+
+// Returns false without printing an error if the file can't be opened or is empty.
+bool MappedFileOpen(MappedFile* file, const char* path);
+void MappedFileClose(MappedFile* file);
+
+struct MeshFile
+{
+	// point into the mapping
+	const float* Positions = NULL;
+	const uint32_t* Indices = NULL;
+	uint32_t NumVertices = 0;
+	uint32_t NumTris = 0;
+
+	MappedFile Mapping;
+};
+
+// Maps the file and checks its header and size. Prints an error and returns false on failure.
+bool MeshFileOpen(MeshFile* mesh, const char* path);
+void MeshFileClose(MeshFile* mesh);
+
+// Writes positions (float4s) and indices (3 per triangle) as a mesh file. Prints an error and returns false on failure.
+bool MeshFileWrite(const char* path, const float* positions, uint32_t numVertices, const uint32_t* indices, uint32_t numTris);
@@ -0,0 +1,492 @@
+#include "meshopt.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+// Triangles per vertex cache optimization chunk. Chunks are optimized independently, in parallel,
+// which only costs a few misses at their boundaries.
+static const uint32_t kMeshOptChunkTris = 1 << 16;
+
+static const int kMeshOptMaxCacheSize = 256;
+
+static const char* kMeshOptModeNames[] = {
+	"none",
+	"vertex-cache",
+	"bin-locality",
+	"both"
+};
+
+const char* MeshOptModeName(MeshOptMode mode)
+{
+	return mode >= 0 && mode < MESHOPT_MODE_COUNT ? kMeshOptModeNames[mode] : "unknown";
+}
+
+static uint32_t MortonCode(uint32_t x, uint32_t y)
+{
+	uint32_t code = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		code |= ((x >> i) & 1) << (2 * i);
+		code |= ((y >> i) & 1) << (2 * i + 1);
+	}
+	return code;
+}
+
+// Screen space positions of the vertices, with the same viewport transform as the rasterizer.
+// Vertices behind the eye (w <= 0) are NaN.
+static std::vector<float> ScreenPositions(const float* positions, uint32_t numVertices, int width, int height)
+{
+	std::vector<float> screen((size_t)numVertices * 2);
+
+	JobsParallelFor((int)((numVertices + kMeshOptChunkTris - 1) / kMeshOptChunkTris), 1, [&](int chunk)
+	{
+		uint32_t first = (uint32_t)chunk * kMeshOptChunkTris;
+		uint32_t last = std::min(first + kMeshOptChunkTris, numVertices);
+		for (uint32_t v = first; v < last; v++)
+		{
+			const float* pos = &positions[(size_t)v * 4];
+			if (pos[3] > 0.0f)
+			{
+				screen[(size_t)v * 2 + 0] = (pos[0] / pos[3] * 0.5f + 0.5f) * (float)width;
+				screen[(size_t)v * 2 + 1] = (0.5f - pos[1] / pos[3] * 0.5f) * (float)height;
+			}
+			else
+			{
+				screen[(size_t)v * 2 + 0] = NAN;
+				screen[(size_t)v * 2 + 1] = NAN;
+			}
+		}
+	});
+
+	return screen;
+}
+
+// Returns false if a vertex is out of range or behind the eye.
+static bool TriangleScreen(const std::vector<float>& screen, const uint32_t* tri, uint32_t numVertices, float x[3], float y[3])
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (tri[i] >= numVertices)
+			return false;
+		x[i] = screen[(size_t)tri[i] * 2 + 0];
+		y[i] = screen[(size_t)tri[i] * 2 + 1];
+		if (std::isnan(x[i]))
+			return false;
+	}
+	return true;
+}
+
+struct MeshOptBins
+{
+	int NumBinsX;
+	int NumBinsY;
+	// Morton code of the last bin + 1
+	uint32_t NumKeys;
+};
+
+static MeshOptBins MakeBins(const MeshOptParams& params)
+{
+	MeshOptBins bins;
+	bins.NumBinsX = (std::max(params.Width, 1) + std::max(params.BinWidth, 1) - 1) / std::max(params.BinWidth, 1);
+	bins.NumBinsY = (std::max(params.Height, 1) + std::max(params.BinHeight, 1) - 1) / std::max(params.BinHeight, 1);
+	bins.NumKeys = MortonCode(bins.NumBinsX - 1, bins.NumBinsY - 1) + 1;
+	return bins;
+}
+
+// Stable counting sort of the triangles by the Morton code of the bin of their centroid.
+// Writes the sorted triangle IDs to order, and the first sorted triangle of each key to keyStarts (NumKeys + 1 entries).
+static void SortByBin(std::vector<uint32_t>* order, std::vector<uint32_t>* keyStarts,
+	const uint32_t* indices, uint32_t numTris, const float* positions, uint32_t numVertices, const MeshOptParams& params)
+{
+	MeshOptBins bins = MakeBins(params);
+	std::vector<float> screen = ScreenPositions(positions, numVertices, params.Width, params.Height);
+
+	uint32_t numChunks = (numTris + kMeshOptChunkTris - 1) / kMeshOptChunkTris;
+	std::vector<uint32_t> keys(numTris);
+	std::vector<uint32_t> counts((size_t)numChunks * bins.NumKeys);
+
+	JobsParallelFor((int)numChunks, 1, [&](int chunk)
+	{
+		uint32_t first = (uint32_t)chunk * kMeshOptChunkTris;
+		uint32_t last = std::min(first + kMeshOptChunkTris, numTris);
+		uint32_t* chunkCounts = &counts[(size_t)chunk * bins.NumKeys];
+		for (uint32_t t = first; t < last; t++)
+		{
+			// triangles that aren't on screen go to the first bin
+			float x[3], y[3];
+			int binX = 0, binY = 0;
+			if (TriangleScreen(screen, &indices[(size_t)t * 3], numVertices, x, y))
+			{
+				float cx = (x[0] + x[1] + x[2]) / 3.0f;
+				float cy = (y[0] + y[1] + y[2]) / 3.0f;
+				binX = (int)std::min(std::max(cx / (float)params.BinWidth, 0.0f), (float)(bins.NumBinsX - 1));
+				binY = (int)std::min(std::max(cy / (float)params.BinHeight, 0.0f), (float)(bins.NumBinsY - 1));
+			}
+			keys[t] = MortonCode(binX, binY);
+			chunkCounts[keys[t]]++;
+		}
+	});
+
+	// exclusive prefix sum, by key then by chunk, so each chunk scatters after the previous chunks of the same key
+	keyStarts->assign(bins.NumKeys + 1, 0);
+	uint32_t offset = 0;
+	for (uint32_t key = 0; key < bins.NumKeys; key++)
+	{
+		(*keyStarts)[key] = offset;
+		for (uint32_t chunk = 0; chunk < numChunks; chunk++)
+		{
+			uint32_t count = counts[(size_t)chunk * bins.NumKeys + key];
+			counts[(size_t)chunk * bins.NumKeys + key] = offset;
+			offset += count;
+		}
+	}
+	(*keyStarts)[bins.NumKeys] = offset;
+
+	order->resize(numTris);
+	JobsParallelFor((int)numChunks, 1, [&](int chunk)
+	{
+		uint32_t first = (uint32_t)chunk * kMeshOptChunkTris;
+		uint32_t last = std::min(first + kMeshOptChunkTris, numTris);
+		uint32_t* chunkOffsets = &counts[(size_t)chunk * bins.NumKeys];
+		for (uint32_t t = first; t < last; t++)
+		{
+			(*order)[chunkOffsets[keys[t]]++] = t;
+		}
+	});
+}
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation".
+struct ForsythScores
+{
+	float Cache[kMeshOptMaxCacheSize + 3];
+	float Valence[32];
+	int CacheSize;
+};
+
+static ForsythScores MakeForsythScores(int cacheSize)
+{
+	ForsythScores scores;
+	scores.CacheSize = cacheSize;
+
+	for (int i = 0; i < cacheSize + 3; i++)
+	{
+		if (i < 3)
+			scores.Cache[i] = 0.75f; // the last triangle's vertices, whatever its order
+		else if (i < cacheSize)
+			scores.Cache[i] = std::pow(1.0f - (float)(i - 3) / (float)(cacheSize - 3), 1.5f);
+		else
+			scores.Cache[i] = 0.0f;
+	}
+
+	// favor vertices with few triangles left, to finish them off
+	scores.Valence[0] = 0.0f;
+	for (int i = 1; i < 32; i++)
+		scores.Valence[i] = 2.0f / std::sqrt((float)i);
+
+	return scores;
+}
+
+static float ForsythVertexScore(const ForsythScores& scores, int cachePos, uint32_t remaining)
+{
+	if (remaining == 0)
+		return -1.0f;
+
+	float score = cachePos >= 0 ? scores.Cache[cachePos] : 0.0f;
+	score += remaining < 32 ? scores.Valence[remaining] : 2.0f / std::sqrt((float)remaining);
+	return score;
+}
+
+// Reorders the triangles tris[0..numTris) of indices and writes their indices to dst.
+static void OptimizeVertexCache(uint32_t* dst, const uint32_t* indices, const uint32_t* tris, uint32_t numTris, const ForsythScores& scores)
+{
+	// local vertex IDs, so the chunk's data fits in cache whatever the size of the mesh
+	std::vector<uint32_t> localIndices((size_t)numTris * 3);
+	for (uint32_t t = 0; t < numTris; t++)
+	{
+		for (int i = 0; i < 3; i++)
+			localIndices[(size_t)t * 3 + i] = indices[(size_t)tris[t] * 3 + i];
+	}
+
+	std::vector<uint32_t> vertices(localIndices);
+	std::sort(vertices.begin(), vertices.end());
+	vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+	for (uint32_t& v : localIndices)
+		v = (uint32_t)(std::lower_bound(vertices.begin(), vertices.end(), v) - vertices.begin());
+
+	uint32_t numVertices = (uint32_t)vertices.size();
+
+	// triangles of each vertex
+	std::vector<uint32_t> remaining(numVertices);
+	for (uint32_t v : localIndices)
+		remaining[v]++;
+
+	std::vector<uint32_t> adjacencyStart(numVertices + 1);
+	for (uint32_t v = 0; v < numVertices; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+
+	std::vector<uint32_t> adjacency(localIndices.size());
+	{
+		std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (uint32_t t = 0; t < numTris; t++)
+		{
+			for (int i = 0; i < 3; i++)
+				adjacency[fill[localIndices[(size_t)t * 3 + i]]++] = t;
+		}
+	}
+
+	std::vector<int> cachePos(numVertices, -1);
+	std::vector<float> vertexScore(numVertices);
+	for (uint32_t v = 0; v < numVertices; v++)
+		vertexScore[v] = ForsythVertexScore(scores, -1, remaining[v]);
+
+	std::vector<float> triScore(numTris);
+	std::vector<uint8_t> added(numTris);
+	int bestTri = -1;
+	float bestScore = -1.0f;
+	for (uint32_t t = 0; t < numTris; t++)
+	{
+		const uint32_t* tri = &localIndices[(size_t)t * 3];
+		triScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+		if (triScore[t] > bestScore)
+		{
+			bestScore = triScore[t];
+			bestTri = (int)t;
+		}
+	}
+
+	// the cache keeps 3 extra entries, the vertices being pushed out, so their triangles' scores get updated
+	uint32_t cache[kMeshOptMaxCacheSize + 3];
+	uint32_t newCache[kMeshOptMaxCacheSize + 6];
+	int cacheCount = 0;
+	uint32_t nextUnadded = 0;
+
+	for (uint32_t out = 0; out < numTris; out++)
+	{
+		if (bestTri < 0)
+		{
+			// nothing adjacent to the cache left, continue in the original order
+			while (added[nextUnadded])
+				nextUnadded++;
+			bestTri = (int)nextUnadded;
+		}
+
+		const uint32_t* tri = &localIndices[(size_t)bestTri * 3];
+		added[bestTri] = 1;
+		for (int i = 0; i < 3; i++)
+		{
+			dst[(size_t)out * 3 + i] = vertices[tri[i]];
+			remaining[tri[i]]--;
+		}
+
+		// the triangle's vertices go to the front, the others keep their order
+		int newCount = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			if (std::find(newCache, newCache + newCount, tri[i]) == newCache + newCount)
+				newCache[newCount++] = tri[i];
+		}
+		for (int i = 0; i < cacheCount; i++)
+		{
+			if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+				newCache[newCount++] = cache[i];
+		}
+
+		for (int i = scores.CacheSize + 3; i < newCount; i++)
+			cachePos[newCache[i]] = -1;
+		cacheCount = std::min(newCount, scores.CacheSize + 3);
+
+		for (int i = 0; i < cacheCount; i++)
+		{
+			uint32_t v = newCache[i];
+			cache[i] = v;
+			cachePos[v] = i < scores.CacheSize ? i : -1;
+			vertexScore[v] = ForsythVertexScore(scores, cachePos[v], remaining[v]);
+		}
+
+		// rescore the triangles of the cached vertices and pick the next one among them
+		bestTri = -1;
+		bestScore = -1.0f;
+		for (int i = 0; i < cacheCount; i++)
+		{
+			uint32_t v = cache[i];
+			for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; a++)
+			{
+				uint32_t t = adjacency[a];
+				if (added[t])
+					continue;
+
+				const uint32_t* adjTri = &localIndices[(size_t)t * 3];
+				triScore[t] = vertexScore[adjTri[0]] + vertexScore[adjTri[1]] + vertexScore[adjTri[2]];
+				if (triScore[t] > bestScore)
+				{
+					bestScore = triScore[t];
+					bestTri = (int)t;
+				}
+			}
+		}
+	}
+}
+
+void MeshOptReorder(uint32_t* dst, const uint32_t* indices, uint32_t numTris, const float* positions, uint32_t numVertices, const MeshOptParams& params)
+{
+	// triangles in their new order, and the ranges of it optimized for the vertex cache
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> rangeStarts;
+
+	if (params.Mode == MESHOPT_BIN_LOCALITY || params.Mode == MESHOPT_BOTH)
+	{
+		std::vector<uint32_t> keyStarts;
+		SortByBin(&order, &keyStarts, indices, numTris, positions, numVertices, params);
+
+		for (size_t key = 0; key + 1 < keyStarts.size(); key++)
+		{
+			for (uint32_t t = keyStarts[key]; t < keyStarts[key + 1]; t += kMeshOptChunkTris)
+				rangeStarts.push_back(t);
+		}
+	}
+	else
+	{
+		order.resize(numTris);
+		for (uint32_t t = 0; t < numTris; t++)
+			order[t] = t;
+
+		for (uint32_t t = 0; t < numTris; t += kMeshOptChunkTris)
+			rangeStarts.push_back(t);
+	}
+
+	if (params.Mode == MESHOPT_VERTEX_CACHE || params.Mode == MESHOPT_BOTH)
+	{
+		ForsythScores scores = MakeForsythScores(std::min(std::max(params.CacheSize, 4), kMeshOptMaxCacheSize));
+
+		rangeStarts.push_back(numTris);
+		JobsParallelFor((int)rangeStarts.size() - 1, 1, [&](int range)
+		{
+			uint32_t first = rangeStarts[range];
+			uint32_t count = std::min(rangeStarts[range + 1] - first, kMeshOptChunkTris);
+			OptimizeVertexCache(&dst[(size_t)first * 3], indices, &order[first], count, scores);
+		});
+	}
+	else
+	{
+		JobsParallelFor((int)((numTris + kMeshOptChunkTris - 1) / kMeshOptChunkTris), 1, [&](int chunk)
+		{
+			uint32_t first = (uint32_t)chunk * kMeshOptChunkTris;
+			uint32_t last = std::min(first + kMeshOptChunkTris, numTris);
+			for (uint32_t t = first; t < last; t++)
+			{
+				for (int i = 0; i < 3; i++)
+					dst[(size_t)t * 3 + i] = indices[(size_t)order[t] * 3 + i];
+			}
+		});
+	}
+}
+
+void MeshOptAnalyze(MeshOptStats* stats, const uint32_t* indices, uint32_t numTris, const float* positions, uint32_t numVertices,
+	const MeshOptParams& params, const VCacheParams& vcacheParams)
+{
+	VCacheSimulate(&stats->VCache, indices, numTris, numVertices, vcacheParams);
+
+	MeshOptBins bins = MakeBins(params);
+	std::vector<float> screen = ScreenPositions(positions, numVertices, params.Width, params.Height);
+
+	// bins overlapped by each triangle's bounding box, empty if it's off screen
+	std::vector<int16_t> binRects((size_t)numTris * 4);
+	uint32_t numChunks = (numTris + kMeshOptChunkTris - 1) / kMeshOptChunkTris;
+	std::vector<double> chunkDistances(numChunks);
+	std::vector<uint32_t> chunkNumDistances(numChunks);
+
+	JobsParallelFor((int)numChunks, 1, [&](int chunk)
+	{
+		uint32_t first = (uint32_t)chunk * kMeshOptChunkTris;
+		uint32_t last = std::min(first + kMeshOptChunkTris, numTris);
+
+		double distance = 0.0;
+		uint32_t numDistances = 0;
+		bool prevValid = false;
+		float prevX = 0.0f, prevY = 0.0f;
+		if (first > 0)
+		{
+			float x[3], y[3];
+			prevValid = TriangleScreen(screen, &indices[(size_t)(first - 1) * 3], numVertices, x, y);
+			prevX = (x[0] + x[1] + x[2]) / 3.0f;
+			prevY = (y[0] + y[1] + y[2]) / 3.0f;
+		}
+
+		for (uint32_t t = first; t < last; t++)
+		{
+			int16_t* rect = &binRects[(size_t)t * 4];
+			rect[0] = rect[1] = 0;
+			rect[2] = rect[3] = -1;
+
+			float x[3], y[3];
+			bool valid = TriangleScreen(screen, &indices[(size_t)t * 3], numVertices, x, y);
+			if (!valid)
+			{
+				prevValid = false;
+				continue;
+			}
+
+			float minX = std::min(x[0], std::min(x[1], x[2]));
+			float minY = std::min(y[0], std::min(y[1], y[2]));
+			float maxX = std::max(x[0], std::max(x[1], x[2]));
+			float maxY = std::max(y[0], std::max(y[1], y[2]));
+			if (maxX >= 0.0f && maxY >= 0.0f && minX < (float)params.Width && minY < (float)params.Height)
+			{
+				rect[0] = (int16_t)std::max((int)(minX / (float)params.BinWidth), 0);
+				rect[1] = (int16_t)std::max((int)(minY / (float)params.BinHeight), 0);
+				rect[2] = (int16_t)std::min((int)(maxX / (float)params.BinWidth), bins.NumBinsX - 1);
+				rect[3] = (int16_t)std::min((int)(maxY / (float)params.BinHeight), bins.NumBinsY - 1);
+			}
+
+			float cx = (x[0] + x[1] + x[2]) / 3.0f;
+			float cy = (y[0] + y[1] + y[2]) / 3.0f;
+			if (prevValid)
+			{
+				distance += std::sqrt((double)(cx - prevX) * (cx - prevX) + (double)(cy - prevY) * (cy - prevY));
+				numDistances++;
+			}
+			prevValid = true;
+			prevX = cx;
+			prevY = cy;
+		}
+
+		chunkDistances[chunk] = distance;
+		chunkNumDistances[chunk] = numDistances;
+	});
+
+	// one bin row per job, each scanning all the triangles
+	std::atomic<uint64_t> switches(0);
+	JobsParallelFor(bins.NumBinsY, 1, [&](int binY)
+	{
+		std::vector<uint32_t> lastTri(bins.NumBinsX, UINT32_MAX);
+		uint64_t rowSwitches = 0;
+		for (uint32_t t = 0; t < numTris; t++)
+		{
+			const int16_t* rect = &binRects[(size_t)t * 4];
+			if (binY < rect[1] || binY > rect[3])
+				continue;
+
+			for (int binX = rect[0]; binX <= rect[2]; binX++)
+			{
+				if (lastTri[binX] == UINT32_MAX || lastTri[binX] + 1 != t)
+					rowSwitches++;
+				lastTri[binX] = t;
+			}
+		}
+		switches += rowSwitches;
+	});
+
+	double distance = 0.0;
+	uint64_t numDistances = 0;
+	for (uint32_t chunk = 0; chunk < numChunks; chunk++)
+	{
+		distance += chunkDistances[chunk];
+		numDistances += chunkNumDistances[chunk];
+	}
+
+	stats->BinSwitchesPerBin = (double)switches / (double)(bins.NumBinsX * bins.NumBinsY);
+	stats->MeanCentroidDistance = numDistances > 0 ? distance / (double)numDistances : 0.0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Triangle reordering of index buffers, for the post-transform vertex cache (see vcache.h) and for bin locality,
+// and the before/after statistics to judge it.
+// Reordering changes which triangle is drawn last over a pixel, so it changes the image of the triangles pass.
+
+#include "vcache.h"
+
+#include <cstdint>
+
+enum MeshOptMode
+{
+	MESHOPT_NONE,
+	// Forsyth's linear-speed vertex cache optimization, on independent chunks of triangles in parallel
+	MESHOPT_VERTEX_CACHE,
+	// stable sort of the triangles by the bin of their centroid, bins in Morton order
+	MESHOPT_BIN_LOCALITY,
+	// bin locality, then vertex cache optimization of the triangles of each bin
+	MESHOPT_BOTH,
+	MESHOPT_MODE_COUNT
+};
+
+struct MeshOptParams
+{
+	MeshOptMode Mode = MESHOPT_BOTH;
+	// cache size the vertex cache optimization scores for
+	int CacheSize = 32;
+	// screen and bins used for bin locality and for the statistics
+	int Width = 1280;
+	int Height = 720;
+	int BinWidth = 64;
+	int BinHeight = 64;
+};
+
+struct MeshOptStats
+{
+	VCacheStats VCache;
+	// Number of times the triangle stream enters a bin (a triangle overlapping it follows one that doesn't), averaged over the bins.
+	// Triangles overlap the bins of their bounding box.
+	double BinSwitchesPerBin;
+	// Mean distance in pixels between the centroids of consecutive triangles, lower is more coherent shading order.
+	double MeanCentroidDistance;
+};
+
+const char* MeshOptModeName(MeshOptMode mode);
+
+// Writes the reordered triangles to dst (numTris * 3 indices, not overlapping indices).
+// Positions are clip space float4s, as in mesh files (see mesh.h). Runs in parallel on the job system (see jobs.h).
+void MeshOptReorder(uint32_t* dst, const uint32_t* indices, uint32_t numTris, const float* positions, uint32_t numVertices, const MeshOptParams& params);
+
+// vcacheParams is the simulated cache, which can differ from the one optimized for.
+void MeshOptAnalyze(MeshOptStats* stats, const uint32_t* indices, uint32_t numTris, const float* positions, uint32_t numVertices,
+	const MeshOptParams& params, const VCacheParams& vcacheParams);
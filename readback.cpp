@@ -0,0 +1,80 @@
+#include "readback.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+void ReadbackInit(ReadbackRing* ring, int depth)
+{
+	depth = std::max(depth, 1);
+
+	*ring = ReadbackRing();
+	ring->Results.resize(depth);
+	ring->Ready.resize(depth);
+}
+
+int ReadbackIssue(ReadbackRing* ring, uint64_t frame)
+{
+	uint64_t depth = ring->Results.size();
+	if (ring->NumIssued - ring->NumPolled == depth)
+	{
+		ring->NumPolled++;
+		ring->NumDropped++;
+	}
+
+	int slot = (int)(ring->NumIssued % depth);
+	ring->Results[slot].Frame = frame;
+	ring->Ready[slot] = false;
+	ring->NumIssued++;
+	return slot;
+}
+
+bool ReadbackPoll(ReadbackRing* ring, ReadbackResult* result)
+{
+	if (ring->NumPolled == ring->NumIssued)
+		return false;
+
+	int slot = (int)(ring->NumPolled % ring->Results.size());
+	if (!ring->Ready[slot])
+		return false;
+
+	// swapped rather than copied, the slot reuses the image storage of result
+	std::swap(*result, ring->Results[slot]);
+	ring->NumPolled++;
+	return true;
+}
+
+void ReadbackIssueCPU(ReadbackRing* ring, uint64_t frame, uint32_t pixelCounter, uint32_t maxNumPixels, const SoftRastTarget* resolved)
+{
+	int slot = ReadbackIssue(ring, frame);
+	ReadbackResult& result = ring->Results[slot];
+
+	result.PixelCounter = pixelCounter;
+	// orders 0 to MaxNumPixels are shaded
+	result.PixelsShaded = maxNumPixels < pixelCounter ? maxNumPixels + 1 : pixelCounter;
+
+	if (resolved)
+	{
+		int bps = SoftRastBytesPerSample(resolved->Format);
+		result.Width = resolved->Width;
+		result.Height = resolved->Height;
+		result.Format = resolved->Format;
+		result.Image.resize((size_t)resolved->Width * resolved->Height * bps);
+
+		// the 8 pixels of each row of a tile are consecutive whatever the layout
+		for (int y = 0; y < resolved->Height; y++)
+		{
+			for (int x = 0; x < resolved->Width; x += 8)
+			{
+				int n = std::min(resolved->Width - x, 8);
+				memcpy(&result.Image[((size_t)y * resolved->Width + x) * bps], &resolved->Data[SoftRastPixelIndex(resolved, x, y) * bps], (size_t)n * bps);
+			}
+		}
+	}
+	else
+	{
+		result.Image.clear();
+	}
+
+	ring->Ready[slot] = true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// Asynchronous readback of what frames drew: the final PixelCounterUAV value and, optionally, the resolved image.
+// Frames are issued in order and their results polled in the same order some frames later, without waiting for them.
+// The Toolbox fills the ring from the GPU through staging resources (see gpureadback.h), the headless tool from the CPU
+// targets with ReadbackIssueCPU, and both consume it with ReadbackPoll.
+
+#include "softrast.h"
+
+#include <cstdint>
+#include <vector>
+
+static const int kReadbackDefaultDepth = 3;
+
+struct ReadbackResult
+{
+	uint64_t Frame = 0;
+	// pixel shader invocations, including the ones discarded by MaxNumPixels
+	uint32_t PixelCounter = 0;
+	// invocations that weren't discarded
+	uint32_t PixelsShaded = 0;
+
+	// the resolved image in its format, rows packed. Empty if it wasn't read back.
+	int Width = 0;
+	int Height = 0;
+	SoftRastFormat Format = SOFTRAST_FORMAT_R8G8B8A8_UNORM;
+	std::vector<uint8_t> Image;
+};
+
+// Depth frames can be in flight: issuing a frame while depth frames aren't polled yet drops the oldest.
+struct ReadbackRing
+{
+	std::vector<ReadbackResult> Results;
+	// set by the backend once a frame's result is filled in
+	std::vector<uint8_t> Ready;
+	uint64_t NumIssued = 0;
+	uint64_t NumPolled = 0;
+	uint64_t NumDropped = 0;
+};
+
+void ReadbackInit(ReadbackRing* ring, int depth);
+
+// Returns the slot of the next frame, for the backend to fill in and mark ready.
+int ReadbackIssue(ReadbackRing* ring, uint64_t frame);
+
+// Moves the result of the oldest frame to result if it's ready, and returns whether it was.
+bool ReadbackPoll(ReadbackRing* ring, ReadbackResult* result);
+
+// The results of CPU draws are ready when they're issued. resolved is the single-sampled target written by SoftRastResolve,
+// or NULL not to read back the image.
+void ReadbackIssueCPU(ReadbackRing* ring, uint64_t frame, uint32_t pixelCounter, uint32_t maxNumPixels, const SoftRastTarget* resolved);
@@ -1,9 +1,18 @@
 #include "scene.h"
+#include "softrast.h"
+#include "mesh.h"
+#include "workloads.h"
+#include "vcache.h"
+#include "meshopt.h"
+#include "capture.h"
+#include "gputiming.h"
+#include "gpureadback.h"
 #include "imgui/imgui.h"
 
 #include <d3dcompiler.h>
 #include "dxutil.h"
 
+#include <algorithm>
 #include <vector>
 
 static ID3D11Device* g_Device;
@@ -32,6 +41,73 @@ static ID3D11UnorderedAccessView* g_PixelCountUAV;
 
 static ID3D11Buffer* g_MaxNumPixelsBuffer;
 
+// shading order captured by triangles.hlsl with ORDER_CAPTURE:
+// first order, first triangle ID, last order, last triangle ID
+static const int kNumOrderTextures = 4;
+static ID3D11Texture2D* g_OrderTex2Ds[kNumOrderTextures];
+static ID3D11UnorderedAccessView* g_OrderUAVs[kNumOrderTextures];
+static ID3D11ShaderResourceView* g_OrderSRVs[kNumOrderTextures];
+static const UINT kOrderClearValues[kNumOrderTextures] = { UINT_MAX, UINT_MAX, 0, 0 };
+
+// mesh file or generated workload drawn by triangles.hlsl with MESH, see UploadMesh
+static ID3D11Buffer* g_MeshPositionsBuffer;
+static ID3D11ShaderResourceView* g_MeshPositionsSRV;
+static ID3D11Buffer* g_MeshIndicesBuffer;
+static ID3D11ShaderResourceView* g_MeshIndicesSRV;
+static int g_MeshNumTris;
+static UINT g_MeshNumVertices;
+static char g_MeshPath[260];
+
+static int g_WorkloadIndex;
+static int g_WorkloadNumTris = 10000;
+static float g_WorkloadOverlap = 1.0f;
+static int g_WorkloadSeed = 1;
+
+// whether the mesh is drawn with DrawIndexed, and its simulated vertex cache statistics
+static bool g_Indexed;
+static int g_VCacheSize = 32;
+static int g_VCacheReplacementIndex = VCACHE_FIFO;
+static int g_VCacheBatchTris;
+static VCacheStats g_VCacheStats;
+
+// triangle reordering applied when loading or generating, and its effects
+static int g_ReorderIndex;
+static MeshOptStats g_ReorderStatsBefore;
+static MeshOptStats g_ReorderStatsAfter;
+
+static ID3D11VertexShader* g_ThresholdVS;
+static ID3D11PixelShader* g_ThresholdPS;
+
+// What g_TrianglesRTV holds, so that with the shading order captured,
+// changing only the percent rebuilds it with the threshold pass instead of drawing all the triangles again.
+static bool g_TrianglesValid;
+static int g_TrianglesNumTris;
+static UINT32 g_TrianglesMaxNumPixels;
+
+// Pipeline statistics and occlusion queries of the triangles draws, read back a few draws later without waiting for the GPU.
+// Each keeps the MaxNumPixels and bytes per sample of its draw, to get the discarded invocations and bytes written.
+struct PipelineStatsQuery
+{
+	ID3D11Query* Statistics;
+	ID3D11Query* Occlusion;
+	UINT32 MaxNumPixels;
+	int BytesPerSample;
+};
+static const int kNumPipelineStatsQueries = 4;
+static PipelineStatsQuery g_PipelineStatsQueries[kNumPipelineStatsQueries];
+static uint64_t g_NumPipelineStatsQueriesIssued;
+static uint64_t g_NumPipelineStatsQueriesRead;
+// of the last draw read back
+static SoftRastPipelineStats g_PipelineStats;
+static bool g_PipelineStatsValid;
+
+// PixelCounterUAV value and, optionally, resolved image of the triangles draws, read back a few frames later (see readback.h)
+static ReadbackRing g_Readback;
+static bool g_ReadbackImage;
+static ReadbackResult g_ReadbackResult;
+static bool g_ReadbackValid;
+static uint64_t g_FrameIndex;
+
 static D3D11_VIEWPORT g_Viewport;
 
 // The vertex shader always outputs at least 8 floats:
@@ -43,6 +119,11 @@ static float g_MaxNumPixelsPercent;
 static int g_NumFloatsPerVertex = kNumNonExtraFloats;
 static int g_PixelFormatIndex;
 static int g_SampleCountIndex;
+static bool g_CaptureOrder;
+
+// the next frame is drawn in full and written as a capture file (see capture.h)
+static char g_CaptureFramePath[260] = "frame.tbcap";
+static bool g_CaptureFrameRequested;
 
 static const char* kPixelFormatNames[] = {
 	"(32 bpp) R8G8B8A8_UNORM",
@@ -56,14 +137,10 @@ static const DXGI_FORMAT kPixelFormatFormats[] = {
 	DXGI_FORMAT_R32G32B32A32_FLOAT
 };
 
-static const char* kSampleCountNames[] = {
+static const char* kSampleCountNames[kSoftRastNumSampleCounts] = {
 	"1","2","4","8"
 };
 
-static const UINT kSampleCountCounts[] = {
-	1, 2, 4, 8
-};
-
 void RebuildShaders()
 {
 	ID3D11Device* dev = g_Device;
@@ -73,6 +150,8 @@ void RebuildShaders()
 	ComPtr<ID3DBlob> TrianglesPSBlob;
 	ComPtr<ID3DBlob> BlitVSBlob;
 	ComPtr<ID3DBlob> BlitPSBlob;
+	ComPtr<ID3DBlob> ThresholdVSBlob;
+	ComPtr<ID3DBlob> ThresholdPSBlob;
 
 	struct ShaderToCompile
 	{
@@ -85,12 +164,17 @@ void RebuildShaders()
 
 	std::string numExtraFloatsStr = std::to_string(g_NumFloatsPerVertex - kNumNonExtraFloats);
 	D3D_SHADER_MACRO numExtraFloatsMacro{ "NUM_EXTRA_FLOATs", numExtraFloatsStr.c_str() };
+	D3D_SHADER_MACRO orderCaptureMacro{ "ORDER_CAPTURE", g_CaptureOrder ? "1" : "0" };
+	D3D_SHADER_MACRO meshMacro{ "MESH", g_MeshNumTris > 0 ? "1" : "0" };
+	D3D_SHADER_MACRO indexedMacro{ "INDEXED", g_Indexed ? "1" : "0" };
 
 	ShaderToCompile shadersToCompile[] = {
-		{ L"triangles.hlsl", "VSmain", "vs_5_0", &TrianglesVSBlob, { numExtraFloatsMacro } },
-		{ L"triangles.hlsl", "PSmain", "ps_5_0", &TrianglesPSBlob, { numExtraFloatsMacro } },
+		{ L"triangles.hlsl", "VSmain", "vs_5_0", &TrianglesVSBlob, { numExtraFloatsMacro, orderCaptureMacro, meshMacro, indexedMacro } },
+		{ L"triangles.hlsl", "PSmain", "ps_5_0", &TrianglesPSBlob, { numExtraFloatsMacro, orderCaptureMacro, meshMacro, indexedMacro } },
 		{ L"blit.hlsl", "VSmain", "vs_5_0", &BlitVSBlob,{ } },
 		{ L"blit.hlsl", "PSmain", "ps_5_0", &BlitPSBlob,{ } },
+		{ L"threshold.hlsl", "VSmain", "vs_5_0", &ThresholdVSBlob, { numExtraFloatsMacro } },
+		{ L"threshold.hlsl", "PSmain", "ps_5_0", &ThresholdPSBlob, { numExtraFloatsMacro } },
 	};
 
 	for (ShaderToCompile& s2c : shadersToCompile)
@@ -134,6 +218,218 @@ void RebuildShaders()
 
 	if (g_BlitPS) g_BlitPS->Release();
 	CHECKHR(dev->CreatePixelShader(BlitPSBlob->GetBufferPointer(), BlitPSBlob->GetBufferSize(), NULL, &g_BlitPS));
+
+	if (g_ThresholdVS) g_ThresholdVS->Release();
+	CHECKHR(dev->CreateVertexShader(ThresholdVSBlob->GetBufferPointer(), ThresholdVSBlob->GetBufferSize(), NULL, &g_ThresholdVS));
+
+	if (g_ThresholdPS) g_ThresholdPS->Release();
+	CHECKHR(dev->CreatePixelShader(ThresholdPSBlob->GetBufferPointer(), ThresholdPSBlob->GetBufferSize(), NULL, &g_ThresholdPS));
+
+	g_TrianglesValid = false;
+}
+
+static void UnloadMesh()
+{
+	if (g_MeshPositionsSRV) { g_MeshPositionsSRV->Release(); g_MeshPositionsSRV = NULL; }
+	if (g_MeshPositionsBuffer) { g_MeshPositionsBuffer->Release(); g_MeshPositionsBuffer = NULL; }
+	if (g_MeshIndicesSRV) { g_MeshIndicesSRV->Release(); g_MeshIndicesSRV = NULL; }
+	if (g_MeshIndicesBuffer) { g_MeshIndicesBuffer->Release(); g_MeshIndicesBuffer = NULL; }
+	g_MeshNumTris = 0;
+	g_MeshNumVertices = 0;
+}
+
+// Uploads positions (float4s) and indices (3 per triangle) into immutable buffers,
+// reordering the triangles and simulating the vertex cache on the indices while they're still in memory.
+static void UploadMesh(const float* positions, UINT numVertices, const UINT32* indices, UINT numTris)
+{
+	ID3D11Device* dev = g_Device;
+
+	UnloadMesh();
+
+	if (numVertices == 0 || numTris == 0)
+		return;
+
+	VCacheParams vcacheParams;
+	vcacheParams.CacheSize = g_VCacheSize;
+	vcacheParams.Replacement = (VCacheReplacement)g_VCacheReplacementIndex;
+	vcacheParams.BatchTris = g_VCacheBatchTris;
+
+	std::vector<UINT32> reorderedIndices;
+	if (g_ReorderIndex != MESHOPT_NONE)
+	{
+		MeshOptParams meshOptParams;
+		meshOptParams.Mode = (MeshOptMode)g_ReorderIndex;
+		meshOptParams.CacheSize = g_VCacheSize;
+		meshOptParams.Width = (int)g_Viewport.Width;
+		meshOptParams.Height = (int)g_Viewport.Height;
+
+		MeshOptAnalyze(&g_ReorderStatsBefore, indices, numTris, positions, numVertices, meshOptParams, vcacheParams);
+		reorderedIndices.resize((size_t)numTris * 3);
+		MeshOptReorder(reorderedIndices.data(), indices, numTris, positions, numVertices, meshOptParams);
+		indices = reorderedIndices.data();
+		MeshOptAnalyze(&g_ReorderStatsAfter, indices, numTris, positions, numVertices, meshOptParams, vcacheParams);
+	}
+
+	D3D11_SUBRESOURCE_DATA positionsData = { positions };
+	CHECKHR(dev->CreateBuffer(
+		&CD3D11_BUFFER_DESC(numVertices * 4 * sizeof(float), D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE, 0, D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, 4 * sizeof(float)),
+		&positionsData,
+		&g_MeshPositionsBuffer));
+
+	CHECKHR(dev->CreateShaderResourceView(
+		g_MeshPositionsBuffer,
+		&CD3D11_SHADER_RESOURCE_VIEW_DESC(g_MeshPositionsBuffer, DXGI_FORMAT_UNKNOWN, 0, numVertices),
+		&g_MeshPositionsSRV));
+
+	D3D11_SUBRESOURCE_DATA indicesData = { indices };
+	CHECKHR(dev->CreateBuffer(
+		&CD3D11_BUFFER_DESC(numTris * 3 * sizeof(UINT32), D3D11_BIND_INDEX_BUFFER | D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE),
+		&indicesData,
+		&g_MeshIndicesBuffer));
+
+	CHECKHR(dev->CreateShaderResourceView(
+		g_MeshIndicesBuffer,
+		&CD3D11_SHADER_RESOURCE_VIEW_DESC(g_MeshIndicesBuffer, DXGI_FORMAT_R32_UINT, 0, numTris * 3),
+		&g_MeshIndicesSRV));
+
+	g_MeshNumTris = (int)numTris;
+	g_MeshNumVertices = numVertices;
+	g_NumTris = g_MeshNumTris;
+
+	VCacheSimulate(&g_VCacheStats, indices, numTris, numVertices, vcacheParams);
+}
+
+// Uploads the mesh straight from the file mapping, then unmaps it,
+// so the mesh is neither parsed nor kept in memory a second time.
+static void LoadMesh(const char* path)
+{
+	MeshFile mesh;
+	if (!MeshFileOpen(&mesh, path))
+		return;
+
+	UploadMesh(mesh.Positions, mesh.NumVertices, mesh.Indices, mesh.NumTris);
+	MeshFileClose(&mesh);
+}
+
+// The half-screen workload unloads the mesh.
+static void GenerateWorkload()
+{
+	WorkloadParams params;
+	params.Type = (WorkloadType)g_WorkloadIndex;
+	params.NumTris = g_WorkloadNumTris;
+	params.Overlap = g_WorkloadOverlap;
+	params.Seed = (uint32_t)g_WorkloadSeed;
+
+	Workload workload;
+	WorkloadGenerate(&workload, params);
+	UploadMesh(workload.Positions.get(), workload.NumVertices, workload.Indices.get(), workload.NumTris);
+}
+
+// Copies a buffer the CPU can't read through a staging buffer. Waits for the GPU.
+static void ReadBackBuffer(ID3D11Buffer* buffer, std::vector<uint8_t>* data)
+{
+	D3D11_BUFFER_DESC desc;
+	buffer->GetDesc(&desc);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	ComPtr<ID3D11Buffer> staging;
+	CHECKHR(g_Device->CreateBuffer(&desc, NULL, &staging));
+	g_DeviceContext->CopyResource(staging.Get(), buffer);
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	CHECKHR(g_DeviceContext->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &mapped));
+	data->assign((const uint8_t*)mapped.pData, (const uint8_t*)mapped.pData + desc.ByteWidth);
+	g_DeviceContext->Unmap(staging.Get(), 0);
+}
+
+// Writes the state of the frame being drawn. The mesh isn't kept in memory, so it's read back from its buffers.
+static void WriteFrameCapture(UINT32 maxNumPixels)
+{
+	bool mesh = g_MeshNumTris > 0;
+
+	CaptureFileHeader header = {};
+	header.Width = (uint32_t)g_Viewport.Width;
+	header.Height = (uint32_t)g_Viewport.Height;
+	header.PixelFormatIndex = (uint32_t)g_PixelFormatIndex;
+	header.SampleCountIndex = (uint32_t)g_SampleCountIndex;
+	header.NumTris = (uint32_t)g_NumTris;
+	header.NumFloatsPerVertex = (uint32_t)g_NumFloatsPerVertex;
+	header.MaxNumPixels = maxNumPixels;
+	header.ShaderFlags = (mesh ? CAPTURE_SHADER_MESH : 0) | (mesh && g_Indexed ? CAPTURE_SHADER_INDEXED : 0) |
+		(g_CaptureOrder ? CAPTURE_SHADER_ORDER_CAPTURE : 0);
+	header.NumVertices = mesh ? g_MeshNumVertices : 0;
+
+	std::vector<uint8_t> positions;
+	std::vector<uint8_t> indices;
+	if (mesh)
+	{
+		ReadBackBuffer(g_MeshPositionsBuffer, &positions);
+		ReadBackBuffer(g_MeshIndicesBuffer, &indices);
+	}
+
+	// only the drawn triangles
+	CaptureFileWrite(g_CaptureFramePath, header, (const float*)positions.data(), (const uint32_t*)indices.data());
+}
+
+static bool WorkloadNameGetter(void* data, int idx, const char** outText)
+{
+	*outText = WorkloadTypeName((WorkloadType)idx);
+	return true;
+}
+
+// The statistics of the oldest draw are dropped if they're still not ready.
+static void BeginPipelineStats(UINT32 maxNumPixels)
+{
+	if (g_NumPipelineStatsQueriesIssued - g_NumPipelineStatsQueriesRead == kNumPipelineStatsQueries)
+		g_NumPipelineStatsQueriesRead++;
+
+	PipelineStatsQuery& query = g_PipelineStatsQueries[g_NumPipelineStatsQueriesIssued % kNumPipelineStatsQueries];
+	query.MaxNumPixels = maxNumPixels;
+	query.BytesPerSample = SoftRastBytesPerSample((SoftRastFormat)g_PixelFormatIndex);
+	g_DeviceContext->Begin(query.Statistics);
+	g_DeviceContext->Begin(query.Occlusion);
+}
+
+static void EndPipelineStats()
+{
+	PipelineStatsQuery& query = g_PipelineStatsQueries[g_NumPipelineStatsQueriesIssued % kNumPipelineStatsQueries];
+	g_DeviceContext->End(query.Occlusion);
+	g_DeviceContext->End(query.Statistics);
+	g_NumPipelineStatsQueriesIssued++;
+}
+
+static void ReadPipelineStats()
+{
+	ID3D11DeviceContext* dc = g_DeviceContext;
+
+	while (g_NumPipelineStatsQueriesRead < g_NumPipelineStatsQueriesIssued)
+	{
+		const PipelineStatsQuery& query = g_PipelineStatsQueries[g_NumPipelineStatsQueriesRead % kNumPipelineStatsQueries];
+
+		D3D11_QUERY_DATA_PIPELINE_STATISTICS statistics;
+		UINT64 numSamples;
+		if (dc->GetData(query.Statistics, &statistics, sizeof(statistics), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+			dc->GetData(query.Occlusion, &numSamples, sizeof(numSamples), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+			break;
+
+		// orders 0 to MaxNumPixels are kept, the others discarded (see triangles.hlsl)
+		UINT64 numKept = std::min(statistics.PSInvocations, (UINT64)query.MaxNumPixels + 1);
+
+		g_PipelineStats.VSInvocations = statistics.VSInvocations;
+		g_PipelineStats.Primitives = statistics.CPrimitives;
+		g_PipelineStats.PSInvocations = statistics.PSInvocations;
+		g_PipelineStats.PSInvocationsDiscarded = statistics.PSInvocations - numKept;
+		// there's no depth buffer, so the occlusion query counts the samples of the pixels that aren't discarded
+		g_PipelineStats.SamplesWritten = numSamples;
+		g_PipelineStats.BytesWritten = numSamples * query.BytesPerSample;
+		g_PipelineStatsValid = true;
+
+		g_NumPipelineStatsQueriesRead++;
+	}
 }
 
 void SceneInit(ID3D11Device* dev, ID3D11DeviceContext* dc)
@@ -141,6 +437,16 @@ void SceneInit(ID3D11Device* dev, ID3D11DeviceContext* dc)
 	g_Device = dev;
 	g_DeviceContext = dc;
 
+	GpuTimingInit(dev, dc);
+	GpuReadbackInit(dev, dc, kReadbackDefaultDepth);
+	ReadbackInit(&g_Readback, kReadbackDefaultDepth);
+
+	for (PipelineStatsQuery& query : g_PipelineStatsQueries)
+	{
+		CHECKHR(dev->CreateQuery(&CD3D11_QUERY_DESC(D3D11_QUERY_PIPELINE_STATISTICS), &query.Statistics));
+		CHECKHR(dev->CreateQuery(&CD3D11_QUERY_DESC(D3D11_QUERY_OCCLUSION), &query.Occlusion));
+	}
+
 	RebuildShaders();
 
 	// triangles pipeline
@@ -202,11 +508,14 @@ void SceneResize(int width, int height)
 	g_Viewport.MaxDepth = 1.0f;
 
 	DXGI_FORMAT trianglesFormat = kPixelFormatFormats[g_PixelFormatIndex];
-	UINT sampleCount = kSampleCountCounts[g_SampleCountIndex];
+	UINT sampleCount = (UINT)kSoftRastSampleCounts[g_SampleCountIndex];
+
+	// standard sample positions, which the CPU triangles pass (softrast.h) uses too, rather than the driver's
+	UINT sampleQuality = sampleCount > 1 ? D3D11_STANDARD_MULTISAMPLE_PATTERN : 0;
 
 	if (g_TrianglesTex2DMS) g_TrianglesTex2DMS->Release();
 	CHECKHR(dev->CreateTexture2D(
-		&CD3D11_TEXTURE2D_DESC(trianglesFormat, width, height, 1, 1, D3D11_BIND_RENDER_TARGET, D3D11_USAGE_DEFAULT, 0, sampleCount, 0, 0),
+		&CD3D11_TEXTURE2D_DESC(trianglesFormat, width, height, 1, 1, D3D11_BIND_RENDER_TARGET, D3D11_USAGE_DEFAULT, 0, sampleCount, sampleQuality, 0),
 		NULL,
 		&g_TrianglesTex2DMS));
 
@@ -227,6 +536,29 @@ void SceneResize(int width, int height)
 		g_TrianglesTex2D,
 		&CD3D11_SHADER_RESOURCE_VIEW_DESC(D3D11_SRV_DIMENSION_TEXTURE2D, trianglesFormat, 0, 1),
 		&g_TrianglesSRV));
+
+	for (int i = 0; i < kNumOrderTextures; i++)
+	{
+		if (g_OrderTex2Ds[i]) g_OrderTex2Ds[i]->Release();
+		CHECKHR(dev->CreateTexture2D(
+			&CD3D11_TEXTURE2D_DESC(DXGI_FORMAT_R32_UINT, width, height, 1, 1, D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE),
+			NULL,
+			&g_OrderTex2Ds[i]));
+
+		if (g_OrderUAVs[i]) g_OrderUAVs[i]->Release();
+		CHECKHR(dev->CreateUnorderedAccessView(
+			g_OrderTex2Ds[i],
+			&CD3D11_UNORDERED_ACCESS_VIEW_DESC(D3D11_UAV_DIMENSION_TEXTURE2D, DXGI_FORMAT_R32_UINT),
+			&g_OrderUAVs[i]));
+
+		if (g_OrderSRVs[i]) g_OrderSRVs[i]->Release();
+		CHECKHR(dev->CreateShaderResourceView(
+			g_OrderTex2Ds[i],
+			&CD3D11_SHADER_RESOURCE_VIEW_DESC(D3D11_SRV_DIMENSION_TEXTURE2D, DXGI_FORMAT_R32_UINT, 0, 1),
+			&g_OrderSRVs[i]));
+	}
+
+	g_TrianglesValid = false;
 }
 
 void ScenePaint(ID3D11RenderTargetView* backbufferRTV)
@@ -234,11 +566,84 @@ void ScenePaint(ID3D11RenderTargetView* backbufferRTV)
 	ID3D11Device* dev = g_Device;
 	ID3D11DeviceContext* dc = g_DeviceContext;
 
-	ImGui::SetNextWindowSize(ImVec2(550, 250), ImGuiSetCond_Once);
+	ReadPipelineStats();
+
+	GpuReadbackUpdate(&g_Readback);
+	while (ReadbackPoll(&g_Readback, &g_ReadbackResult))
+	{
+		g_ReadbackValid = true;
+	}
+
+	ImGui::SetNextWindowSize(ImVec2(550, 330), ImGuiSetCond_Once);
 	if (ImGui::Begin("Toolbox"))
 	{
-		ImGui::SliderInt("Num triangles", &g_NumTris, 0, 1000);
+		ImGui::InputText("Mesh file", g_MeshPath, sizeof(g_MeshPath));
+		ImGui::SameLine();
+		if (ImGui::Button("Load"))
+		{
+			LoadMesh(g_MeshPath);
+			RebuildShaders();
+		}
+		if (g_MeshNumTris > 0)
+		{
+			ImGui::SameLine();
+			if (ImGui::Button("Unload"))
+			{
+				UnloadMesh();
+				g_NumTris = std::min(g_NumTris, 1000);
+				RebuildShaders();
+			}
+		}
+
+		ImGui::Combo("Workload", &g_WorkloadIndex, WorkloadNameGetter, NULL, WORKLOAD_COUNT);
+		ImGui::SameLine();
+		if (ImGui::Button("Generate"))
+		{
+			GenerateWorkload();
+			g_NumTris = std::min(g_NumTris, g_MeshNumTris > 0 ? g_MeshNumTris : 1000);
+			RebuildShaders();
+		}
+		if (g_WorkloadIndex != WORKLOAD_HALF_SCREEN)
+		{
+			ImGui::InputInt("Workload triangles", &g_WorkloadNumTris, 1000, 100000);
+			if (g_WorkloadNumTris < 0) g_WorkloadNumTris = 0;
+			ImGui::SliderFloat("Overlap", &g_WorkloadOverlap, 0.0f, 16.0f);
+			ImGui::InputInt("Seed", &g_WorkloadSeed);
+		}
+
+		ImGui::Combo("Reorder when loading or generating", &g_ReorderIndex, "None\0Vertex cache\0Bin locality\0Both\0\0");
+
+		if (g_MeshNumTris > 0)
+		{
+			if (ImGui::Checkbox("Indexed draw", &g_Indexed))
+			{
+				RebuildShaders();
+			}
+
+			ImGui::Text("Vertex cache (simulated when loading or generating):");
+			ImGui::InputInt("Cache size", &g_VCacheSize);
+			g_VCacheSize = std::min(std::max(g_VCacheSize, 1), 256);
+			ImGui::Combo("Replacement", &g_VCacheReplacementIndex, "FIFO\0LRU\0\0");
+			ImGui::InputInt("Batch triangles (0: no batches)", &g_VCacheBatchTris);
+			if (g_VCacheBatchTris < 0) g_VCacheBatchTris = 0;
+
+			// vertex outputs that don't need to be written again, at the current number of floats per vertex
+			double savedMB = (double)g_VCacheStats.VertexShaderInvocationsSaved * g_NumFloatsPerVertex * sizeof(float) / (1024.0 * 1024.0);
+			ImGui::Text("ACMR %.3f, ATVR %.3f, %llu vertex shader invocations saved (%.1f MB of vertex outputs)",
+				g_VCacheStats.ACMR, g_VCacheStats.ATVR, (unsigned long long)g_VCacheStats.VertexShaderInvocationsSaved, savedMB);
+
+			if (g_ReorderIndex != MESHOPT_NONE)
+			{
+				ImGui::Text("Reordered: ACMR %.3f -> %.3f, bin switches per bin %.1f -> %.1f, centroid distance %.1f -> %.1f pixels",
+					g_ReorderStatsBefore.VCache.ACMR, g_ReorderStatsAfter.VCache.ACMR,
+					g_ReorderStatsBefore.BinSwitchesPerBin, g_ReorderStatsAfter.BinSwitchesPerBin,
+					g_ReorderStatsBefore.MeanCentroidDistance, g_ReorderStatsAfter.MeanCentroidDistance);
+			}
+		}
+
+		ImGui::SliderInt("Num triangles", &g_NumTris, 0, g_MeshNumTris > 0 ? g_MeshNumTris : 1000);
 		if (g_NumTris < 0) g_NumTris = 0;
+		if (g_MeshNumTris > 0 && g_NumTris > g_MeshNumTris) g_NumTris = g_MeshNumTris;
 		
 		ImGui::SliderFloat("Num pixels (percent)", &g_MaxNumPixelsPercent, 0.0f, 1.0f);
 		if (g_MaxNumPixelsPercent < 0.0f) g_MaxNumPixelsPercent = 0.0f;
@@ -258,38 +663,126 @@ void ScenePaint(ID3D11RenderTargetView* backbufferRTV)
 			SceneResize((int)g_Viewport.Width, (int)g_Viewport.Height);
 		}
 
-		if (ImGui::ListBox("Sample count", &g_SampleCountIndex, kSampleCountNames, _countof(kSampleCountNames)))
+		if (ImGui::ListBox("Sample count", &g_SampleCountIndex, kSampleCountNames, kSoftRastNumSampleCounts))
 		{
 			SceneResize((int)g_Viewport.Width, (int)g_Viewport.Height);
 		}
+
+		if (ImGui::Checkbox("Cache shading order (fast percent changes)", &g_CaptureOrder))
+		{
+			RebuildShaders();
+		}
+
+		ImGui::InputText("Capture file", g_CaptureFramePath, sizeof(g_CaptureFramePath));
+		ImGui::SameLine();
+		if (ImGui::Button("Capture frame"))
+		{
+			g_CaptureFrameRequested = true;
+		}
+
+		// GPU times of the last frames, a few frames late
+		if (ImGui::CollapsingHeader("Timings"))
+		{
+			TimingPercentiles percentiles[TIMING_PASS_COUNT];
+			TimingGetPercentiles(percentiles, kTimingMaxFrames);
+
+			ImGui::Columns(4, "timings");
+			ImGui::Text("Pass"); ImGui::NextColumn();
+			ImGui::Text("Frames"); ImGui::NextColumn();
+			ImGui::Text("p50 (ms)"); ImGui::NextColumn();
+			ImGui::Text("p99 (ms)"); ImGui::NextColumn();
+			ImGui::Separator();
+			for (int pass = 0; pass < TIMING_PASS_COUNT; pass++)
+			{
+				ImGui::Text("%s", TimingPassName((TimingPass)pass)); ImGui::NextColumn();
+				ImGui::Text("%d", percentiles[pass].NumFrames); ImGui::NextColumn();
+				ImGui::Text("%.3f", percentiles[pass].P50Ms); ImGui::NextColumn();
+				ImGui::Text("%.3f", percentiles[pass].P99Ms); ImGui::NextColumn();
+			}
+			ImGui::Columns(1);
+		}
+
+		// of the last triangles draw, a few frames late
+		if (ImGui::CollapsingHeader("Pipeline statistics"))
+		{
+			if (g_PipelineStatsValid)
+			{
+				const SoftRastPipelineStats& stats = g_PipelineStats;
+				ImGui::Text("VS invocations: %llu", (unsigned long long)stats.VSInvocations);
+				ImGui::Text("Primitives after culling: %llu", (unsigned long long)stats.Primitives);
+				ImGui::Text("PS invocations: %llu, %llu discarded by Num pixels",
+					(unsigned long long)stats.PSInvocations, (unsigned long long)stats.PSInvocationsDiscarded);
+				ImGui::Text("Samples written: %llu, %.1f MB (%d floats per vertex, %d bytes per sample)",
+					(unsigned long long)stats.SamplesWritten, stats.BytesWritten / (1024.0 * 1024.0),
+					g_NumFloatsPerVertex, SoftRastBytesPerSample((SoftRastFormat)g_PixelFormatIndex));
+			}
+			else
+			{
+				ImGui::Text("No triangles drawn yet");
+			}
+
+			if (g_ReadbackValid)
+			{
+				ImGui::Text("Pixels shaded: %u of %u invocations (read back %llu frames later)",
+					g_ReadbackResult.PixelsShaded, g_ReadbackResult.PixelCounter, (unsigned long long)(g_FrameIndex - g_ReadbackResult.Frame));
+			}
+			ImGui::Checkbox("Read back the resolved image", &g_ReadbackImage);
+			if (g_ReadbackValid && !g_ReadbackResult.Image.empty())
+			{
+				ImGui::SameLine();
+				ImGui::Text("%dx%d, %.1f MB", g_ReadbackResult.Width, g_ReadbackResult.Height, g_ReadbackResult.Image.size() / (1024.0 * 1024.0));
+			}
+		}
 	}
 	ImGui::End();
 
+	UINT32 maxNumPixels = SoftRastMaxNumPixels(g_MaxNumPixelsPercent, (int)g_Viewport.Width, (int)g_Viewport.Height, g_NumTris);
+
 	{
 		D3D11_MAPPED_SUBRESOURCE mapped;
 		CHECKHR(dc->Map(g_MaxNumPixelsBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
-
-        // not exact, but good enough
-        float pixelsPerTri = 0.5f * g_Viewport.Width * g_Viewport.Height;
-
-        // some fudge factor added to the percent to make 100% always draw all triangles fully and 0% draw nothing
-        float pixelsPercent = g_MaxNumPixelsPercent;
-        if (pixelsPercent == 1.0f)
-            pixelsPercent = 1.01f;
-
-		*(UINT32*)mapped.pData = (UINT32)(pixelsPercent * pixelsPerTri * g_NumTris);
+		*(UINT32*)mapped.pData = maxNumPixels;
 		dc->Unmap(g_MaxNumPixelsBuffer, 0);
 	}
 
+	// a captured frame draws the triangles, so that replaying it doesn't depend on an earlier frame
+	if (g_CaptureFrameRequested)
+	{
+		WriteFrameCapture(maxNumPixels);
+		g_CaptureFrameRequested = false;
+		g_TrianglesValid = false;
+	}
+
+	// without the shading order cache, the triangles are drawn every frame. Meshes and workloads are too: the threshold
+	// pass guesses the triangle of a pixel from its first and last orders, which is only exact for the half-screen triangle.
+	bool drawTriangles = !g_CaptureOrder || !g_TrianglesValid || g_TrianglesNumTris != g_NumTris || g_MeshNumTris > 0;
+	bool threshold = !drawTriangles && g_TrianglesMaxNumPixels != maxNumPixels;
+
 	const float kClearColor[] = { 0, 0, 0, 0 };
-	dc->ClearRenderTargetView(g_TrianglesRTV, kClearColor);
+	if (drawTriangles || threshold)
+	{
+		GpuTimingScope timing(TIMING_PASS_CLEAR);
+		dc->ClearRenderTargetView(g_TrianglesRTV, kClearColor);
+
+		if (drawTriangles && g_CaptureOrder)
+		{
+			for (int i = 0; i < kNumOrderTextures; i++)
+			{
+				const UINT clearValue[] = { kOrderClearValues[i], kOrderClearValues[i], kOrderClearValues[i], kOrderClearValues[i] };
+				dc->ClearUnorderedAccessViewUint(g_OrderUAVs[i], clearValue);
+			}
+		}
+	}
 
 	// draw triangles
+	if (drawTriangles)
 	{
+		GpuTimingScope timing(TIMING_PASS_TRIANGLES);
 		ID3D11RenderTargetView* rtvs[] = { g_TrianglesRTV };
-		ID3D11UnorderedAccessView* uavs[] = { g_PixelCountUAV };
+		ID3D11UnorderedAccessView* uavs[] = { g_PixelCountUAV, g_OrderUAVs[0], g_OrderUAVs[1], g_OrderUAVs[2], g_OrderUAVs[3] };
 		UINT uavCounters[_countof(uavs)] = { 0 };
-		dc->OMSetRenderTargetsAndUnorderedAccessViews(_countof(rtvs), rtvs, NULL, _countof(rtvs), _countof(uavs), uavs, uavCounters);
+		UINT numUAVs = g_CaptureOrder ? _countof(uavs) : 1;
+		dc->OMSetRenderTargetsAndUnorderedAccessViews(_countof(rtvs), rtvs, NULL, _countof(rtvs), numUAVs, uavs, uavCounters);
 		dc->VSSetShader(g_TrianglesVS, NULL, 0);
 		dc->PSSetShader(g_TrianglesPS, NULL, 0);
 		dc->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -299,19 +792,81 @@ void ScenePaint(ID3D11RenderTargetView* backbufferRTV)
 		dc->OMSetBlendState(g_TrianglesBlendState, NULL, UINT_MAX);
 		dc->RSSetViewports(1, &g_Viewport);
 		dc->IASetVertexBuffers(0, 0, NULL, NULL, NULL);
-		dc->IASetIndexBuffer(NULL, DXGI_FORMAT_UNKNOWN, 0);
 		dc->PSSetConstantBuffers(0, 1, &g_MaxNumPixelsBuffer);
-		dc->Draw(g_NumTris * 3, 0);
+		ID3D11ShaderResourceView* meshSRVs[] = { g_MeshPositionsSRV, g_MeshIndicesSRV };
+		dc->VSSetShaderResources(4, _countof(meshSRVs), meshSRVs);
+		BeginPipelineStats(maxNumPixels);
+		if (g_Indexed && g_MeshNumTris > 0)
+		{
+			// the indices are only read by the input assembler, SV_VertexID is the index
+			dc->IASetIndexBuffer(g_MeshIndicesBuffer, DXGI_FORMAT_R32_UINT, 0);
+			dc->DrawIndexed(g_NumTris * 3, 0, 0);
+		}
+		else
+		{
+			dc->IASetIndexBuffer(NULL, DXGI_FORMAT_UNKNOWN, 0);
+			dc->Draw(g_NumTris * 3, 0);
+		}
+		EndPipelineStats();
 		
+		ID3D11ShaderResourceView* resetSRVs[_countof(meshSRVs)] = {};
+		dc->VSSetShaderResources(4, _countof(resetSRVs), resetSRVs);
+		dc->IASetIndexBuffer(NULL, DXGI_FORMAT_UNKNOWN, 0);
+		dc->OMSetRenderTargets(0, NULL, NULL);
+		dc->VSSetShader(NULL, NULL, 0);
+		dc->PSSetShader(NULL, NULL, 0);
+	}
+
+	// rebuild the triangles from the shading order cache
+	if (threshold)
+	{
+		GpuTimingScope timing(TIMING_PASS_TRIANGLES);
+		ID3D11RenderTargetView* rtvs[] = { g_TrianglesRTV };
+		dc->OMSetRenderTargets(_countof(rtvs), rtvs, NULL);
+		dc->VSSetShader(g_ThresholdVS, NULL, 0);
+		dc->PSSetShader(g_ThresholdPS, NULL, 0);
+		dc->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		dc->IASetInputLayout(NULL);
+		dc->RSSetState(g_TrianglesRasterizerState);
+		dc->OMSetDepthStencilState(g_TrianglesDepthStencilState, 0);
+		dc->OMSetBlendState(g_TrianglesBlendState, NULL, UINT_MAX);
+		dc->RSSetViewports(1, &g_Viewport);
+		dc->IASetVertexBuffers(0, 0, NULL, NULL, NULL);
+		dc->IASetIndexBuffer(NULL, DXGI_FORMAT_UNKNOWN, 0);
+		dc->PSSetShaderResources(0, kNumOrderTextures, g_OrderSRVs);
+		ID3D11ShaderResourceView* meshSRVs[] = { g_MeshPositionsSRV, g_MeshIndicesSRV };
+		dc->PSSetShaderResources(4, _countof(meshSRVs), meshSRVs);
+		dc->PSSetConstantBuffers(0, 1, &g_MaxNumPixelsBuffer);
+		dc->Draw(3, 0);
+
+		ID3D11ShaderResourceView* resetSRVs[kNumOrderTextures + _countof(meshSRVs)] = {};
+		dc->PSSetShaderResources(0, _countof(resetSRVs), resetSRVs);
 		dc->OMSetRenderTargets(0, NULL, NULL);
 		dc->VSSetShader(NULL, NULL, 0);
 		dc->PSSetShader(NULL, NULL, 0);
 	}
 
-	dc->ResolveSubresource(g_TrianglesTex2D, 0, g_TrianglesTex2DMS, 0, kPixelFormatFormats[g_PixelFormatIndex]);
+	if (drawTriangles || threshold)
+	{
+		{
+			GpuTimingScope timing(TIMING_PASS_RESOLVE);
+			dc->ResolveSubresource(g_TrianglesTex2D, 0, g_TrianglesTex2DMS, 0, kPixelFormatFormats[g_PixelFormatIndex]);
+		}
+
+		// the threshold pass doesn't use the counter
+		if (drawTriangles)
+		{
+			GpuReadbackIssue(&g_Readback, g_FrameIndex, g_PixelCountUAV, maxNumPixels, g_ReadbackImage ? g_TrianglesTex2D : NULL);
+		}
+
+		g_TrianglesValid = true;
+		g_TrianglesNumTris = g_NumTris;
+		g_TrianglesMaxNumPixels = maxNumPixels;
+	}
 
 	// blit
 	{
+		GpuTimingScope timing(TIMING_PASS_BLIT);
 		ID3D11RenderTargetView* rtvs[] = { backbufferRTV };
 		dc->OMSetRenderTargets(_countof(rtvs), rtvs, NULL);
 		dc->VSSetShader(g_BlitVS, NULL, 0);
@@ -334,4 +889,6 @@ void ScenePaint(ID3D11RenderTargetView* backbufferRTV)
 		dc->VSSetShader(NULL, NULL, 0);
 		dc->PSSetShader(NULL, NULL, 0);
 	}
+
+	g_FrameIndex++;
 }
\ No newline at end of file
@@ -0,0 +1,1588 @@
+#include "softrast.h"
+#include "softrast_kernels.h"
+#include "jobs.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+struct SoftRastVertex
+{
+	float Position[4];
+	// the color, then the extra floats
+	float Varyings[kSoftRastMaxVaryings];
+};
+
+// Screen space positions are snapped to 16.8 fixed point, as D3D does.
+static const int kSoftRastSubPixelBits = 8;
+static const int kSoftRastSubPixels = 1 << kSoftRastSubPixelBits;
+
+// Range of snapped coordinates (in pixels), which bounds the edge function steps.
+static const float kSoftRastMaxCoord = 32767.0f;
+
+struct SoftRastTriangle
+{
+	// snapped screen space vertex positions
+	float X[3];
+	float Y[3];
+
+	// twice the signed area, positive for front faces
+	float Area;
+	float InvArea;
+
+	// edge i goes from vertex i to vertex (i + 1) % 3
+	// DX and DY are the steps of its (float) edge function for one pixel right and one pixel down, used for interpolation
+	float DX[3];
+	float DY[3];
+
+	// Integer edge functions used for coverage, exact in 16.8 fixed point:
+	// the center of pixel (x,y) is inside edge i if EdgeC[i] + EdgeA[i] * (x - MinX) + EdgeB[i] * (y - MinY) >= 0.
+	// The top-left rule is folded into EdgeC (see SetupTriangle).
+	int64_t EdgeC[3];
+	int32_t EdgeA[3];
+	int32_t EdgeB[3];
+
+	// Multi-sample coverage, also exact: sample s of a pixel is inside edge i if the pixel center's edge function
+	// plus SampleDelta[i][s] is >= 0. SampleDeltaMin and SampleDeltaMax are the extremes over the samples, 0 when single-sampled.
+	int32_t SampleDelta[3][kSoftRastMaxSampleCount];
+	int32_t SampleDeltaMin[3];
+	int32_t SampleDeltaMax[3];
+
+	// whether the edge functions fit in 32 bits over the whole bounding box, otherwise they're evaluated in 64 bits
+	bool Edges32;
+
+	// clamped to the viewport
+	int MinX, MinY, MaxX, MaxY;
+};
+
+struct SoftRastPrimitive
+{
+	uint32_t ID;
+	SoftRastVertex Verts[3];
+	SoftRastTriangle Tri;
+	SoftRastVaryingPlanes Planes;
+};
+
+// inclusive pixel bounds
+struct SoftRastRect
+{
+	int MinX, MinY, MaxX, MaxY;
+};
+
+// Single-sampled, each pixel of a bin only needs to be shaded by the last triangle that covers it and isn't discarded:
+// without blending or depth test, the others' colors are overwritten. So binned draws defer shading until all the triangles
+// of a bin are rasterized, keeping the last primitive of each pixel, as the hidden surface removal of tiling GPUs.
+struct SoftRastBinVisibility
+{
+	SoftRastRect Rect;
+	// the bin's primitives in order, and the index of the one being rasterized
+	std::vector<const SoftRastPrimitive*> Prims;
+	uint32_t Current;
+
+	// 1 + index of the last primitive shading each pixel, 0 if none
+	std::vector<uint32_t> PixelLast;
+	// 1 + index of the last primitive shading each whole 8x8 block, as a single entry,
+	// overridden by the pixels whose own index is higher
+	std::vector<uint32_t> BlockLast;
+	int BlocksX;
+};
+
+struct SoftRastDrawContext
+{
+	SoftRastTarget* RT;
+	const SoftRastDrawParams* Params;
+	int NumExtraFloats;
+	// PSmain, specialized for NumExtraFloats
+	SoftRastShade8x8 Shade8x8;
+	int BytesPerSample;
+};
+
+static const float kColors[7][4] = {
+	{ 1,0,0,1 },
+	{ 0,1,0,1 },
+	{ 0,0,1,1 },
+	{ 1,1,0,1 },
+	{ 0,1,1,1 },
+	{ 1,0,1,1 },
+	{ 1,1,1,1 }
+};
+
+const char* SoftRastBinOrderName(SoftRastBinOrder order)
+{
+	switch (order)
+	{
+	case SOFTRAST_BIN_ORDER_ROW_MAJOR: return "row-major";
+	case SOFTRAST_BIN_ORDER_COLUMN_MAJOR: return "column-major";
+	case SOFTRAST_BIN_ORDER_SERPENTINE: return "serpentine";
+	case SOFTRAST_BIN_ORDER_MORTON: return "morton";
+	default: return "unknown";
+	}
+}
+
+const char* SoftRastLayoutName(SoftRastLayout layout)
+{
+	switch (layout)
+	{
+	case SOFTRAST_LAYOUT_LINEAR: return "linear";
+	case SOFTRAST_LAYOUT_TILED: return "tiled";
+	default: return "unknown";
+	}
+}
+
+const char* SoftRastFormatName(SoftRastFormat format)
+{
+	switch (format)
+	{
+	case SOFTRAST_FORMAT_R8G8B8A8_UNORM: return "R8G8B8A8_UNORM";
+	case SOFTRAST_FORMAT_R16G16B16A16_UNORM: return "R16G16B16A16_UNORM";
+	case SOFTRAST_FORMAT_R32G32B32A32_FLOAT: return "R32G32B32A32_FLOAT";
+	default: return "UNKNOWN";
+	}
+}
+
+int SoftRastBytesPerSample(SoftRastFormat format)
+{
+	switch (format)
+	{
+	case SOFTRAST_FORMAT_R8G8B8A8_UNORM: return 4;
+	case SOFTRAST_FORMAT_R16G16B16A16_UNORM: return 8;
+	case SOFTRAST_FORMAT_R32G32B32A32_FLOAT: return 16;
+	default: return 0;
+	}
+}
+
+// D3D11_STANDARD_MULTISAMPLE_PATTERN
+static const int8_t kSamplePositions1[1][2] = { { 0, 0 } };
+static const int8_t kSamplePositions2[2][2] = { { 4, 4 }, { -4, -4 } };
+static const int8_t kSamplePositions4[4][2] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
+static const int8_t kSamplePositions8[8][2] = { { 1, -3 }, { -1, 3 }, { 5, 1 }, { -3, -5 }, { -5, 5 }, { -7, -1 }, { 3, 7 }, { 7, -7 } };
+
+const int8_t (*SoftRastSamplePositions(int sampleCount))[2]
+{
+	switch (sampleCount)
+	{
+	case 1: return kSamplePositions1;
+	case 2: return kSamplePositions2;
+	case 4: return kSamplePositions4;
+	case 8: return kSamplePositions8;
+	default: return NULL;
+	}
+}
+
+uint32_t SoftRastMaxNumPixels(float percent, int width, int height, int numTris)
+{
+	// not exact, but good enough
+	float pixelsPerTri = 0.5f * (float)width * (float)height;
+
+	// some fudge factor added to the percent to make 100% always draw all triangles fully and 0% draw nothing
+	float pixelsPercent = percent;
+	if (pixelsPercent == 1.0f)
+		pixelsPercent = 1.01f;
+
+	// meshes can have millions of triangles
+	float maxNumPixels = pixelsPercent * pixelsPerTri * numTris;
+	return maxNumPixels < 4294967296.0f ? (uint32_t)maxNumPixels : UINT32_MAX;
+}
+
+static float Saturate(float f)
+{
+	// also maps NaN to 0, like the UNORM conversion rules
+	return f > 0.0f ? (f < 1.0f ? f : 1.0f) : 0.0f;
+}
+
+static void EncodeColor(uint8_t* dst, SoftRastFormat format, const float color[4])
+{
+	switch (format)
+	{
+	case SOFTRAST_FORMAT_R8G8B8A8_UNORM:
+		for (int c = 0; c < 4; c++)
+			dst[c] = (uint8_t)(Saturate(color[c]) * 255.0f + 0.5f);
+		break;
+	case SOFTRAST_FORMAT_R16G16B16A16_UNORM:
+		for (int c = 0; c < 4; c++)
+		{
+			uint16_t u = (uint16_t)(Saturate(color[c]) * 65535.0f + 0.5f);
+			memcpy(dst + c * sizeof(u), &u, sizeof(u));
+		}
+		break;
+	case SOFTRAST_FORMAT_R32G32B32A32_FLOAT:
+		memcpy(dst, color, sizeof(float) * 4);
+		break;
+	default:
+		break;
+	}
+}
+
+static void DecodeColor(float color[4], SoftRastFormat format, const uint8_t* src)
+{
+	switch (format)
+	{
+	case SOFTRAST_FORMAT_R8G8B8A8_UNORM:
+		for (int c = 0; c < 4; c++)
+			color[c] = (float)src[c] / 255.0f;
+		break;
+	case SOFTRAST_FORMAT_R16G16B16A16_UNORM:
+		for (int c = 0; c < 4; c++)
+		{
+			uint16_t u;
+			memcpy(&u, src + c * sizeof(u), sizeof(u));
+			color[c] = (float)u / 65535.0f;
+		}
+		break;
+	case SOFTRAST_FORMAT_R32G32B32A32_FLOAT:
+		memcpy(color, src, sizeof(float) * 4);
+		break;
+	default:
+		color[0] = color[1] = color[2] = color[3] = 0.0f;
+		break;
+	}
+}
+
+void SoftRastResize(SoftRastTarget* rt, int width, int height, SoftRastFormat format, int sampleCount, SoftRastLayout layout)
+{
+	rt->Width = width;
+	rt->Height = height;
+	rt->SampleCount = sampleCount;
+	rt->Format = format;
+	rt->Layout = layout;
+
+	// tiles at the right and bottom edges are stored whole
+	size_t numPixels = layout == SOFTRAST_LAYOUT_TILED ? (size_t)((width + 7) & ~7) * ((height + 7) & ~7) : (size_t)width * height;
+	rt->Data.assign(numPixels * sampleCount * SoftRastBytesPerSample(format), 0);
+	rt->PartialCoverage.assign(sampleCount > 1 ? numPixels : 0, 0);
+
+	// the zeroed data is cleared to 0 in every format
+	memset(rt->ClearValue, 0, sizeof(rt->ClearValue));
+	rt->TilesX = (width + 7) / 8;
+	rt->TilesY = (height + 7) / 8;
+	size_t numTiles = (size_t)rt->TilesX * rt->TilesY;
+	rt->TileStates.reset(new std::atomic<uint8_t>[numTiles]);
+	for (size_t i = 0; i < numTiles; i++)
+		rt->TileStates[i].store(SOFTRAST_TILE_WRITTEN, std::memory_order_relaxed);
+}
+
+static void SetTileStates(SoftRastTarget* rt, SoftRastTileState state)
+{
+	size_t numTiles = (size_t)rt->TilesX * rt->TilesY;
+	for (size_t i = 0; i < numTiles; i++)
+		rt->TileStates[i].store((uint8_t)state, std::memory_order_relaxed);
+}
+
+void SoftRastClear(SoftRastTarget* rt, const float color[4])
+{
+	EncodeColor(rt->ClearValue, rt->Format, color);
+	SetTileStates(rt, SOFTRAST_TILE_CLEARED);
+}
+
+static void VSmain(SoftRastVertex* output, const SoftRastDrawParams* params, uint32_t vertexID, int numExtraFloats)
+{
+	static const float kPositions[3][4] = {
+		{ -1, 1, 0, 1 },
+		{ 1, 1, 0, 1 },
+		{ -1, -1, 0, 1 }
+	};
+
+	if (params->MeshIndices)
+	{
+		uint32_t index = params->MeshIndices[vertexID];
+		if (index < params->MeshNumVertices)
+			memcpy(output->Position, &params->MeshPositions[(size_t)index * 4], sizeof(output->Position));
+		else
+			memset(output->Position, 0, sizeof(output->Position));
+
+		if (params->MeshIndexed)
+			vertexID = index;
+	}
+	else
+	{
+		memcpy(output->Position, kPositions[vertexID % 3], sizeof(output->Position));
+	}
+
+	const float* color = kColors[(vertexID / 3) % 7];
+	output->Varyings[0] = color[0] * 0.4f;
+	output->Varyings[1] = color[1] * 0.4f;
+	output->Varyings[2] = color[2] * 0.4f;
+	output->Varyings[3] = color[3];
+
+	for (int i = 0; i < numExtraFloats; i++)
+	{
+		output->Varyings[4 + i] = (float)(vertexID + i);
+	}
+}
+
+// PSmain is the Shade8x8 kernels (see softrast_kernels.h), which interpolate the varyings from these plane equations.
+static void SetupVaryingPlanes(SoftRastVaryingPlanes* planes, const SoftRastTriangle* tri, const SoftRastVertex* verts[3], int numExtraFloats)
+{
+	// the edge opposite to a vertex gives its barycentric weight
+	float bary1DX = tri->DX[2] * tri->InvArea;
+	float bary1DY = tri->DY[2] * tri->InvArea;
+	float bary2DX = tri->DX[0] * tri->InvArea;
+	float bary2DY = tri->DY[0] * tri->InvArea;
+
+	planes->X0 = tri->X[0];
+	planes->Y0 = tri->Y[0];
+
+	for (int i = 0; i < 4 + numExtraFloats; i++)
+	{
+		// relative to the first vertex, so large values (like the extra floats of high vertex IDs) don't cancel out
+		float v0 = verts[0]->Varyings[i];
+		float d1 = verts[1]->Varyings[i] - v0;
+		float d2 = verts[2]->Varyings[i] - v0;
+
+		planes->V0[i] = v0;
+		planes->DX[i] = d1 * bary1DX + d2 * bary2DX;
+		planes->DY[i] = d1 * bary1DY + d2 * bary2DY;
+	}
+}
+
+static int32_t SnapCoord(float f)
+{
+	f = std::min(std::max(f, -kSoftRastMaxCoord), kSoftRastMaxCoord);
+	return (int32_t)std::nearbyint(f * (float)kSoftRastSubPixels);
+}
+
+// floor(a / 2^kSoftRastSubPixelBits) and ceil(a / 2^kSoftRastSubPixelBits), for negative values too
+static int64_t FloorSubPixels(int64_t a)
+{
+	return a >= 0 ? a / kSoftRastSubPixels : -((-a + kSoftRastSubPixels - 1) / kSoftRastSubPixels);
+}
+
+// Returns false if the triangle is culled.
+static bool SetupTriangle(SoftRastTriangle* tri, const SoftRastVertex* verts[3], int width, int height, int sampleCount)
+{
+	int32_t fx[3], fy[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		const float* pos = verts[i]->Position;
+
+		// no clipping is implemented, so triangles crossing the w=0 plane are dropped entirely
+		if (!(pos[3] > 0.0f))
+			return false;
+
+		// viewport transform
+		fx[i] = SnapCoord((pos[0] / pos[3] * 0.5f + 0.5f) * (float)width);
+		fy[i] = SnapCoord((0.5f - pos[1] / pos[3] * 0.5f) * (float)height);
+
+		tri->X[i] = (float)fx[i] / (float)kSoftRastSubPixels;
+		tri->Y[i] = (float)fy[i] / (float)kSoftRastSubPixels;
+	}
+
+	int64_t area = (int64_t)(fx[1] - fx[0]) * (fy[2] - fy[0]) - (int64_t)(fy[1] - fy[0]) * (fx[2] - fx[0]);
+
+	// CULL_BACK with clockwise front faces, as in CD3D11_RASTERIZER_DESC(D3D11_DEFAULT)
+	if (area <= 0)
+		return false;
+
+	tri->Area = (float)area / (float)(kSoftRastSubPixels * kSoftRastSubPixels);
+	tri->InvArea = 1.0f / tri->Area;
+
+	int32_t minFX = std::min(fx[0], std::min(fx[1], fx[2]));
+	int32_t minFY = std::min(fy[0], std::min(fy[1], fy[2]));
+	int32_t maxFX = std::max(fx[0], std::max(fx[1], fx[2]));
+	int32_t maxFY = std::max(fy[0], std::max(fy[1], fy[2]));
+
+	// sample offsets from the pixel center, in 16.8 fixed point
+	const int8_t (*samplePositions)[2] = SoftRastSamplePositions(sampleCount);
+	if (!samplePositions)
+	{
+		samplePositions = SoftRastSamplePositions(1);
+		sampleCount = 1;
+	}
+
+	const int32_t sampleScale = kSoftRastSubPixels / 16;
+	int32_t sampleX[kSoftRastMaxSampleCount], sampleY[kSoftRastMaxSampleCount];
+	int32_t sampleMinX = 0, sampleMinY = 0, sampleMaxX = 0, sampleMaxY = 0;
+	for (int s = 0; s < sampleCount; s++)
+	{
+		sampleX[s] = samplePositions[s][0] * sampleScale;
+		sampleY[s] = samplePositions[s][1] * sampleScale;
+		sampleMinX = s == 0 ? sampleX[s] : std::min(sampleMinX, sampleX[s]);
+		sampleMinY = s == 0 ? sampleY[s] : std::min(sampleMinY, sampleY[s]);
+		sampleMaxX = s == 0 ? sampleX[s] : std::max(sampleMaxX, sampleX[s]);
+		sampleMaxY = s == 0 ? sampleY[s] : std::max(sampleMaxY, sampleY[s]);
+	}
+
+	// pixel centers are at (x + 0.5, y + 0.5), and the bounding box has the pixels with a sample inside the triangle's
+	const int32_t half = kSoftRastSubPixels / 2;
+	tri->MinX = (int)std::max(-FloorSubPixels(half + sampleMaxX - minFX), (int64_t)0);
+	tri->MinY = (int)std::max(-FloorSubPixels(half + sampleMaxY - minFY), (int64_t)0);
+	tri->MaxX = (int)std::min(FloorSubPixels(maxFX - half - sampleMinX), (int64_t)width - 1);
+	tri->MaxY = (int)std::min(FloorSubPixels(maxFY - half - sampleMinY), (int64_t)height - 1);
+
+	if (tri->MinX > tri->MaxX || tri->MinY > tri->MaxY)
+		return false;
+
+	int64_t originX = (int64_t)tri->MinX * kSoftRastSubPixels + half;
+	int64_t originY = (int64_t)tri->MinY * kSoftRastSubPixels + half;
+	int64_t spanX = tri->MaxX - tri->MinX;
+	int64_t spanY = tri->MaxY - tri->MinY;
+
+	tri->Edges32 = true;
+
+	for (int i = 0; i < 3; i++)
+	{
+		int32_t dx = fx[(i + 1) % 3] - fx[i];
+		int32_t dy = fy[(i + 1) % 3] - fy[i];
+		tri->DX[i] = -(float)dy / (float)kSoftRastSubPixels;
+		tri->DY[i] = (float)dx / (float)kSoftRastSubPixels;
+
+		bool isTop = dy == 0 && dx > 0;
+		bool isLeft = dy < 0;
+
+		// The edge function at the center of pixel (MinX + x, MinY + y), in 1/256ths of pixels squared, is
+		// e = e0 + 256 * (dx * y - dy * x), so all pixels share the remainder r of e0 / 256 and
+		// e = 256 * (q + dx * y - dy * x) + r with q = floor(e0 / 256) and 0 <= r < 256.
+		// e >= 0 (top-left edges) is then q + dx * y - dy * x >= 0,
+		// and e > 0 (other edges) is the same with q - 1 when r = 0.
+		int64_t e0 = (int64_t)dx * (originY - fy[i]) - (int64_t)dy * (originX - fx[i]);
+		int64_t q = FloorSubPixels(e0);
+		int64_t r = e0 - q * kSoftRastSubPixels;
+
+		tri->EdgeC[i] = q - (!(isTop || isLeft) && r == 0 ? 1 : 0);
+		tri->EdgeA[i] = -dy;
+		tri->EdgeB[i] = dx;
+
+		// The same with the edge function at sample s, e0 + dx * sampleY - dy * sampleX, gives its own q, whose difference with the
+		// pixel center's is the sample's delta. Sample offsets are 1/16ths of pixels, so the deltas are at most (|dx| + |dy|) / 2.
+		for (int s = 0; s < kSoftRastMaxSampleCount; s++)
+		{
+			if (s >= sampleCount)
+			{
+				tri->SampleDelta[i][s] = tri->SampleDelta[i][0];
+				continue;
+			}
+
+			int64_t se0 = e0 + (int64_t)dx * sampleY[s] - (int64_t)dy * sampleX[s];
+			int64_t sq = FloorSubPixels(se0);
+			int64_t sr = se0 - sq * kSoftRastSubPixels;
+			tri->SampleDelta[i][s] = (int32_t)(sq - (!(isTop || isLeft) && sr == 0 ? 1 : 0) - tri->EdgeC[i]);
+			tri->SampleDeltaMin[i] = s == 0 ? tri->SampleDelta[i][s] : std::min(tri->SampleDeltaMin[i], tri->SampleDelta[i][s]);
+			tri->SampleDeltaMax[i] = s == 0 ? tri->SampleDelta[i][s] : std::max(tri->SampleDeltaMax[i], tri->SampleDelta[i][s]);
+		}
+
+		// edge functions are linear, so their extremes over the bounding box are at its corners
+		int64_t c = tri->EdgeC[i];
+		int64_t ax = (int64_t)tri->EdgeA[i] * spanX;
+		int64_t by = (int64_t)tri->EdgeB[i] * spanY;
+		int64_t emin = c + std::min(ax, (int64_t)0) + std::min(by, (int64_t)0) + tri->SampleDeltaMin[i];
+		int64_t emax = c + std::max(ax, (int64_t)0) + std::max(by, (int64_t)0) + tri->SampleDeltaMax[i];
+		if (emin < INT32_MIN || emax > INT32_MAX)
+			tri->Edges32 = false;
+	}
+
+	return true;
+}
+
+// Returns false if the triangle is culled.
+static bool SetupPrimitive(const SoftRastDrawContext* ctx, SoftRastPrimitive* prim, uint32_t triID)
+{
+	prim->ID = triID;
+
+	for (int i = 0; i < 3; i++)
+	{
+		VSmain(&prim->Verts[i], ctx->Params, triID * 3 + i, ctx->NumExtraFloats);
+	}
+
+	const SoftRastVertex* pverts[3] = { &prim->Verts[0], &prim->Verts[1], &prim->Verts[2] };
+	if (!SetupTriangle(&prim->Tri, pverts, ctx->RT->Width, ctx->RT->Height, ctx->RT->SampleCount))
+		return false;
+
+	SetupVaryingPlanes(&prim->Planes, &prim->Tri, pverts, ctx->NumExtraFloats);
+	return true;
+}
+
+enum SoftRastCoverage
+{
+	SOFTRAST_COVERAGE_REJECT,
+	SOFTRAST_COVERAGE_ACCEPT,
+	SOFTRAST_COVERAGE_PARTIAL
+};
+
+// Classifies the samples of the pixels of rect against the triangle's edges, with the edge functions evaluated with T.
+// Edge functions are linear, so evaluating them at the corners gives their range over the whole rect.
+template <typename T>
+static SoftRastCoverage ClassifyRectT(const SoftRastTriangle* tri, int minX, int minY, int maxX, int maxY)
+{
+	T x0 = (T)(minX - tri->MinX);
+	T y0 = (T)(minY - tri->MinY);
+	T x1 = (T)(maxX - tri->MinX);
+	T y1 = (T)(maxY - tri->MinY);
+
+	bool accept = true;
+
+	for (int i = 0; i < 3; i++)
+	{
+		T c = (T)tri->EdgeC[i];
+		T a = (T)tri->EdgeA[i];
+		T b = (T)tri->EdgeB[i];
+		T emin = c + std::min(a * x0, a * x1) + std::min(b * y0, b * y1) + (T)tri->SampleDeltaMin[i];
+		T emax = c + std::max(a * x0, a * x1) + std::max(b * y0, b * y1) + (T)tri->SampleDeltaMax[i];
+
+		if (emax < 0)
+			return SOFTRAST_COVERAGE_REJECT;
+
+		accept = accept && emin >= 0;
+	}
+
+	return accept ? SOFTRAST_COVERAGE_ACCEPT : SOFTRAST_COVERAGE_PARTIAL;
+}
+
+// rect must be inside the triangle's bounding box.
+static SoftRastCoverage ClassifyRect(const SoftRastTriangle* tri, int minX, int minY, int maxX, int maxY)
+{
+	if (tri->Edges32)
+		return ClassifyRectT<int32_t>(tri, minX, minY, maxX, maxY);
+	else
+		return ClassifyRectT<int64_t>(tri, minX, minY, maxX, maxY);
+}
+
+// Value of edge i at the center of pixel (x,y), clamped to 32 bits.
+// The clamping keeps the sign over an 8x8 block: snapped coordinates are within +-kSoftRastMaxCoord pixels,
+// so the edge function changes by less than 2^28 over the block, and sample deltas are less than 2^24.
+static int32_t EdgeValueClamped(const SoftRastTriangle* tri, int edge, int x, int y)
+{
+	int64_t e = tri->EdgeC[edge] + (int64_t)tri->EdgeA[edge] * (x - tri->MinX) + (int64_t)tri->EdgeB[edge] * (y - tri->MinY);
+	return (int32_t)std::min(std::max(e, -(int64_t)(1 << 30)), (int64_t)(1 << 30));
+}
+
+// Used by the binning front-end to skip bins that the triangle's bounding box touches but the triangle doesn't.
+static bool TriangleOverlapsRect(const SoftRastTriangle* tri, const SoftRastRect& rect)
+{
+	if (tri->MaxX < rect.MinX || tri->MinX > rect.MaxX || tri->MaxY < rect.MinY || tri->MinY > rect.MaxY)
+		return false;
+
+	return ClassifyRect(tri,
+		std::max(rect.MinX, tri->MinX), std::max(rect.MinY, tri->MinY),
+		std::min(rect.MaxX, tri->MaxX), std::min(rect.MaxY, tri->MaxY)) != SOFTRAST_COVERAGE_REJECT;
+}
+
+static void GetBlockColor(float color[4], const SoftRastBlockColors* colors, int i)
+{
+	for (int c = 0; c < 4; c++)
+		color[c] = colors->C[c][i];
+}
+
+// Writes the same encoded color to count consecutive samples.
+static void FillSamples(uint8_t* dst, const uint8_t* encoded, int bps, int count)
+{
+	switch (bps)
+	{
+	case 4:
+		for (int i = 0; i < count; i++)
+			memcpy(dst + i * 4, encoded, 4);
+		break;
+	case 8:
+		for (int i = 0; i < count; i++)
+			memcpy(dst + i * 8, encoded, 8);
+		break;
+	case 16:
+		for (int i = 0; i < count; i++)
+			memcpy(dst + i * 16, encoded, 16);
+		break;
+	default:
+		for (int i = 0; i < count; i++)
+			memcpy(dst + i * bps, encoded, bps);
+		break;
+	}
+}
+
+// Before the first write to a cleared tile, fills it with the clear value (see SoftRastTarget::TileStates).
+// Bins drawn in parallel can share a tile, in which case one fills it and the others wait for it.
+static void MaterializeTile(SoftRastTarget* rt, int tileX, int tileY)
+{
+	std::atomic<uint8_t>& state = rt->TileStates[(size_t)tileY * rt->TilesX + tileX];
+	if (state.load(std::memory_order_acquire) == SOFTRAST_TILE_WRITTEN)
+		return;
+
+	uint8_t expected = SOFTRAST_TILE_CLEARED;
+	if (!state.compare_exchange_strong(expected, (uint8_t)SOFTRAST_TILE_MATERIALIZING, std::memory_order_acquire))
+	{
+		while (state.load(std::memory_order_acquire) != SOFTRAST_TILE_WRITTEN)
+			std::this_thread::yield();
+		return;
+	}
+
+	int bps = SoftRastBytesPerSample(rt->Format);
+	int x = tileX * 8;
+	int n = std::min(rt->Width - x, 8);
+	int y1 = std::min(tileY * 8 + 8, rt->Height);
+	for (int y = tileY * 8; y < y1; y++)
+	{
+		size_t pixelIndex = SoftRastPixelIndex(rt, x, y);
+		FillSamples(&rt->Data[pixelIndex * rt->SampleCount * bps], rt->ClearValue, bps, n * rt->SampleCount);
+		if (rt->SampleCount > 1)
+			memset(&rt->PartialCoverage[pixelIndex], 0, n);
+	}
+
+	state.store(SOFTRAST_TILE_WRITTEN, std::memory_order_release);
+}
+
+// Runs PSmain on the pixels of an 8x8 block in mask, and writes their colors to their covered samples.
+// sampleMasks has the covered samples of each pixel (see CoverageSamples8x8), NULL if all of them are covered.
+static void ShadeBlock(const SoftRastDrawContext* ctx, const SoftRastPrimitive* prim, int blockX, int blockY, uint64_t mask, const uint8_t* sampleMasks)
+{
+	uint32_t rowMask = 0;
+	for (int y = 0; y < 8; y++)
+	{
+		if ((mask >> (y * 8)) & 0xFF)
+			rowMask |= 1u << y;
+	}
+
+	SoftRastBlockColors colors;
+	ctx->Shade8x8(&colors, &prim->Planes, blockX, blockY, rowMask);
+
+	MaterializeTile(ctx->RT, blockX / 8, blockY / 8);
+
+	int bps = ctx->BytesPerSample;
+	int sampleCount = ctx->RT->SampleCount;
+	uint32_t allSamples = (1u << sampleCount) - 1;
+	uint8_t encoded[16];
+	uint8_t encodedRow[8 * 16];
+
+	for (int y = 0; y < 8; y++)
+	{
+		uint32_t rowBits = (uint32_t)(mask >> (y * 8)) & 0xFF;
+		if (!rowBits)
+			continue;
+
+		// the samples of the row's pixels are contiguous
+		size_t rowPixelIndex = SoftRastPixelIndex(ctx->RT, blockX, blockY + y);
+		uint8_t* dst = &ctx->RT->Data[rowPixelIndex * sampleCount * bps];
+		// per pixel so that bins splitting a block don't race
+		uint8_t* partialCoverage = sampleCount > 1 ? &ctx->RT->PartialCoverage[rowPixelIndex] : NULL;
+
+		if (rowBits == 0xFF && !sampleMasks)
+		{
+			for (int x = 0; x < 8; x++)
+			{
+				float color[4];
+				GetBlockColor(color, &colors, y * 8 + x);
+				EncodeColor(&encodedRow[x * bps], ctx->RT->Format, color);
+			}
+
+			if (sampleCount == 1)
+			{
+				memcpy(dst, encodedRow, 8 * bps);
+				continue;
+			}
+
+			for (int x = 0; x < 8; x++)
+			{
+				FillSamples(dst + (size_t)x * sampleCount * bps, &encodedRow[x * bps], bps, sampleCount);
+			}
+			memset(partialCoverage, 0, 8);
+			continue;
+		}
+
+		while (rowBits)
+		{
+			int x = SoftRastBitScanForward64(rowBits);
+			rowBits &= rowBits - 1;
+
+			float color[4];
+			GetBlockColor(color, &colors, y * 8 + x);
+			EncodeColor(encoded, ctx->RT->Format, color);
+
+			uint8_t* pixelDst = dst + (size_t)x * sampleCount * bps;
+			uint32_t samples = sampleMasks ? sampleMasks[y * 8 + x] : allSamples;
+			if (partialCoverage)
+				partialCoverage[x] = samples != allSamples;
+			if (samples == allSamples)
+			{
+				FillSamples(pixelDst, encoded, bps, sampleCount);
+				continue;
+			}
+
+			while (samples)
+			{
+				int s = SoftRastBitScanForward64(samples);
+				samples &= samples - 1;
+				memcpy(pixelDst + s * bps, encoded, bps);
+			}
+		}
+	}
+}
+
+// Shades the pixels of an 8x8 block in mask, or only records prim as the last one to shade them if visibility isn't NULL.
+static void ShadeOrDeferBlock(const SoftRastDrawContext* ctx, const SoftRastPrimitive* prim, int blockX, int blockY, uint64_t mask, const uint8_t* sampleMasks,
+	SoftRastBinVisibility* visibility)
+{
+	if (!visibility)
+	{
+		ShadeBlock(ctx, prim, blockX, blockY, mask, sampleMasks);
+		return;
+	}
+
+	const SoftRastRect& rect = visibility->Rect;
+	uint32_t last = visibility->Current + 1;
+
+	if (mask == ~0ull)
+	{
+		int blockIndex = (blockY - (rect.MinY & ~7)) / 8 * visibility->BlocksX + (blockX - (rect.MinX & ~7)) / 8;
+		visibility->BlockLast[blockIndex] = last;
+		return;
+	}
+
+	int width = rect.MaxX - rect.MinX + 1;
+	while (mask)
+	{
+		int bit = SoftRastBitScanForward64(mask);
+		mask &= mask - 1;
+
+		int x = blockX + bit % 8 - rect.MinX;
+		int y = blockY + bit / 8 - rect.MinY;
+		visibility->PixelLast[(size_t)y * width + x] = last;
+	}
+}
+
+// Shades each pixel of the bin once, with the last primitive recorded for it.
+static void ShadeBinVisibility(const SoftRastDrawContext* ctx, const SoftRastBinVisibility* visibility)
+{
+	const SoftRastRect& rect = visibility->Rect;
+	int width = rect.MaxX - rect.MinX + 1;
+	uint32_t blockLasts[64];
+
+	int blockIndex = 0;
+	for (int blockY = rect.MinY & ~7; blockY <= rect.MaxY; blockY += 8)
+	{
+		for (int blockX = rect.MinX & ~7; blockX <= rect.MaxX; blockX += 8, blockIndex++)
+		{
+			uint32_t blockLast = visibility->BlockLast[blockIndex];
+			uint64_t pending = 0;
+			for (int y = std::max(blockY, rect.MinY); y <= std::min(blockY + 7, rect.MaxY); y++)
+			{
+				for (int x = std::max(blockX, rect.MinX); x <= std::min(blockX + 7, rect.MaxX); x++)
+				{
+					uint32_t last = std::max(visibility->PixelLast[(size_t)(y - rect.MinY) * width + x - rect.MinX], blockLast);
+					if (!last)
+						continue;
+
+					int bit = (y - blockY) * 8 + x - blockX;
+					blockLasts[bit] = last;
+					pending |= 1ull << bit;
+				}
+			}
+
+			// one call per primitive visible in the block
+			while (pending)
+			{
+				uint32_t last = blockLasts[SoftRastBitScanForward64(pending)];
+				uint64_t mask = 0;
+				for (uint64_t bits = pending; bits; bits &= bits - 1)
+				{
+					int bit = SoftRastBitScanForward64(bits);
+					if (blockLasts[bit] == last)
+						mask |= 1ull << bit;
+				}
+
+				ShadeBlock(ctx, visibility->Prims[last - 1], blockX, blockY, mask, NULL);
+				pending &= ~mask;
+			}
+		}
+	}
+}
+
+// Returns the mask of the pixels of the 8x8 block at (blockX,blockY) that are inside [minX,maxX]x[minY,maxY].
+static uint64_t BlockClipMask(int blockX, int blockY, int minX, int minY, int maxX, int maxY)
+{
+	int x0 = std::max(minX - blockX, 0);
+	int y0 = std::max(minY - blockY, 0);
+	int x1 = std::min(maxX - blockX, 7);
+	int y1 = std::min(maxY - blockY, 7);
+
+	uint64_t rowMask = (0xFFull << x0) & (0xFFull >> (7 - x1));
+
+	uint64_t mask = 0;
+	for (int y = y0; y <= y1; y++)
+		mask |= rowMask << (y * 8);
+	return mask;
+}
+
+// samples is the mask of the covered samples of the pixel.
+static void RecordOrder(const SoftRastDrawContext* ctx, const SoftRastPrimitive* prim, int x, int y, uint32_t order, uint32_t samples)
+{
+	SoftRastOrderBuffer* ob = ctx->Params->OrderBuffer;
+	size_t index = ((size_t)y * ob->Width + x) * ob->SampleCount;
+
+	for (int s = 0; s < ob->SampleCount; s++)
+	{
+		if (!(samples & (1u << s)))
+			continue;
+
+		if (ob->FirstOrder[index + s] == kSoftRastOrderNone)
+		{
+			ob->FirstOrder[index + s] = order;
+			ob->FirstTriangleID[index + s] = prim->ID;
+		}
+
+		// a pixel is only ever shaded by one thread, in increasing order
+		ob->LastOrder[index + s] = order;
+		ob->LastTriangleID[index + s] = prim->ID;
+	}
+}
+
+// Returns the number of covered samples of the pixels of an 8x8 block in mask. sampleMasks is as in ShadeBlock.
+static uint64_t CountSamples(uint64_t mask, const uint8_t* sampleMasks, int sampleCount)
+{
+	if (!sampleMasks)
+		return (uint64_t)SoftRastPopCount64(mask) * sampleCount;
+
+	uint64_t numSamples = 0;
+	while (mask)
+	{
+		int bit = SoftRastBitScanForward64(mask);
+		mask &= mask - 1;
+		numSamples += SoftRastPopCount64(sampleMasks[bit]);
+	}
+	return numSamples;
+}
+
+// Shades the covered pixels of an 8x8 block, or only counts them if shade is false.
+// A pixel is covered if any of its samples is. sampleMasks is as in ShadeBlock.
+// If pipelineStats isn't NULL, the shaded block's invocations and samples are added to it.
+// If visibility isn't NULL, shading is deferred (see SoftRastBinVisibility).
+static void RasterizeBlock(const SoftRastDrawContext* ctx, const SoftRastPrimitive* prim, int blockX, int blockY, uint64_t mask, const uint8_t* sampleMasks,
+	uint32_t* pixelCounter, bool shade, SoftRastPipelineStats* pipelineStats, SoftRastBinVisibility* visibility)
+{
+	uint32_t maxNumPixels = ctx->Params->MaxNumPixels;
+	bool captureOrder = shade && ctx->Params->OrderBuffer;
+	int numCovered = SoftRastPopCount64(mask);
+
+	if (shade && pipelineStats)
+		pipelineStats->PSInvocations += numCovered;
+
+	// nothing to shade when the whole block is past MaxNumPixels (unless the 32-bit counter wraps around)
+	if (!shade || (!captureOrder && *pixelCounter > maxNumPixels && *pixelCounter <= UINT32_MAX - numCovered))
+	{
+		if (shade && pipelineStats)
+			pipelineStats->PSInvocationsDiscarded += numCovered;
+		*pixelCounter += numCovered;
+		return;
+	}
+
+	if (mask == ~0ull && *pixelCounter <= maxNumPixels && maxNumPixels - *pixelCounter >= 63)
+	{
+		if (captureOrder)
+		{
+			for (int i = 0; i < 64; i++)
+				RecordOrder(ctx, prim, blockX + i % 8, blockY + i / 8, *pixelCounter + i, sampleMasks ? sampleMasks[i] : ~0u);
+		}
+
+		*pixelCounter += 64;
+		ShadeOrDeferBlock(ctx, prim, blockX, blockY, ~0ull, sampleMasks, visibility);
+		if (pipelineStats)
+			pipelineStats->SamplesWritten += CountSamples(~0ull, sampleMasks, ctx->RT->SampleCount);
+		return;
+	}
+
+	// pixels not discarded by MaxNumPixels, shaded together
+	uint64_t shadeMask = 0;
+
+	while (mask)
+	{
+		int bit = SoftRastBitScanForward64(mask);
+		mask &= mask - 1;
+
+		int x = blockX + bit % 8;
+		int y = blockY + bit / 8;
+
+		// PixelCounterUAV.IncrementCounter() returns the value before incrementing
+		uint32_t order = (*pixelCounter)++;
+
+		if (captureOrder)
+			RecordOrder(ctx, prim, x, y, order, sampleMasks ? sampleMasks[bit] : ~0u);
+
+		if (order > maxNumPixels)
+			continue;
+
+		shadeMask |= 1ull << bit;
+	}
+
+	if (pipelineStats)
+	{
+		pipelineStats->PSInvocationsDiscarded += numCovered - SoftRastPopCount64(shadeMask);
+		pipelineStats->SamplesWritten += CountSamples(shadeMask, sampleMasks, ctx->RT->SampleCount);
+	}
+
+	if (shadeMask)
+		ShadeOrDeferBlock(ctx, prim, blockX, blockY, shadeMask, sampleMasks, visibility);
+}
+
+// Rasterizes the part of the triangle inside rect, incrementing pixelCounter for every covered pixel.
+// Coarse tiles are classified first, then the 8x8 blocks of partially covered tiles, then the pixels of partially covered blocks.
+// Tiles, blocks and the pixels inside them are visited in raster order.
+// If shade is false, only the pixels are counted. If stats isn't NULL, the classification results are added to it,
+// and if pipelineStats isn't NULL, the invocations and samples shaded. visibility is as in RasterizeBlock.
+static void RasterizeTriangle(const SoftRastDrawContext* ctx, const SoftRastPrimitive* prim, const SoftRastRect& rect, uint32_t* pixelCounter, bool shade,
+	SoftRastRasterStats* stats, SoftRastPipelineStats* pipelineStats, SoftRastBinVisibility* visibility)
+{
+	const SoftRastTriangle* tri = &prim->Tri;
+	const SoftRastKernels* kernels = SoftRastGetKernels();
+
+	int minX = std::max(tri->MinX, rect.MinX);
+	int minY = std::max(tri->MinY, rect.MinY);
+	int maxX = std::min(tri->MaxX, rect.MaxX);
+	int maxY = std::min(tri->MaxY, rect.MaxY);
+
+	SoftRastBlockEdges edges;
+	for (int i = 0; i < 3; i++)
+	{
+		edges.DX[i] = tri->EdgeA[i];
+		edges.DY[i] = tri->EdgeB[i];
+		memcpy(edges.SampleDelta[i], tri->SampleDelta[i], sizeof(edges.SampleDelta[i]));
+	}
+
+	int sampleCount = ctx->RT->SampleCount;
+	uint8_t sampleMasks[64];
+
+	SoftRastRasterStats localStats;
+
+	for (int tileY = minY & ~(kSoftRastCoarseTileSize - 1); tileY <= maxY; tileY += kSoftRastCoarseTileSize)
+	{
+		for (int tileX = minX & ~(kSoftRastCoarseTileSize - 1); tileX <= maxX; tileX += kSoftRastCoarseTileSize)
+		{
+			int tileMinX = std::max(tileX, minX);
+			int tileMinY = std::max(tileY, minY);
+			int tileMaxX = std::min(tileX + kSoftRastCoarseTileSize - 1, maxX);
+			int tileMaxY = std::min(tileY + kSoftRastCoarseTileSize - 1, maxY);
+
+			SoftRastCoverage tileCoverage = ClassifyRect(tri, tileMinX, tileMinY, tileMaxX, tileMaxY);
+			if (tileCoverage == SOFTRAST_COVERAGE_REJECT)
+			{
+				localStats.TilesRejected++;
+				continue;
+			}
+
+			if (tileCoverage == SOFTRAST_COVERAGE_ACCEPT)
+			{
+				localStats.TilesAccepted++;
+
+				uint32_t numTilePixels = (uint32_t)((tileMaxX - tileMinX + 1) * (tileMaxY - tileMinY + 1));
+				if (!shade)
+				{
+					*pixelCounter += numTilePixels;
+					continue;
+				}
+
+				// none of the tile's pixels are discarded, so deferred shading only has to record its blocks
+				uint32_t maxNumPixels = ctx->Params->MaxNumPixels;
+				if (visibility && !ctx->Params->OrderBuffer && *pixelCounter <= maxNumPixels && maxNumPixels - *pixelCounter >= numTilePixels - 1)
+				{
+					*pixelCounter += numTilePixels;
+					if (pipelineStats)
+					{
+						pipelineStats->PSInvocations += numTilePixels;
+						pipelineStats->SamplesWritten += numTilePixels;
+					}
+
+					for (int blockY = tileMinY & ~7; blockY <= tileMaxY; blockY += 8)
+					{
+						for (int blockX = tileMinX & ~7; blockX <= tileMaxX; blockX += 8)
+						{
+							uint64_t mask = BlockClipMask(blockX, blockY, tileMinX, tileMinY, tileMaxX, tileMaxY);
+							ShadeOrDeferBlock(ctx, prim, blockX, blockY, mask, NULL, visibility);
+						}
+					}
+					continue;
+				}
+
+				// only the clip rect is left to test
+				for (int blockY = tileMinY & ~7; blockY <= tileMaxY; blockY += 8)
+				{
+					for (int blockX = tileMinX & ~7; blockX <= tileMaxX; blockX += 8)
+					{
+						uint64_t mask = BlockClipMask(blockX, blockY, tileMinX, tileMinY, tileMaxX, tileMaxY);
+						RasterizeBlock(ctx, prim, blockX, blockY, mask, NULL, pixelCounter, shade, pipelineStats, visibility);
+					}
+				}
+				continue;
+			}
+
+			localStats.TilesPartial++;
+
+			for (int blockY = tileMinY & ~7; blockY <= tileMaxY; blockY += 8)
+			{
+				for (int blockX = tileMinX & ~7; blockX <= tileMaxX; blockX += 8)
+				{
+					int blockMinX = std::max(blockX, tileMinX);
+					int blockMinY = std::max(blockY, tileMinY);
+					int blockMaxX = std::min(blockX + 7, tileMaxX);
+					int blockMaxY = std::min(blockY + 7, tileMaxY);
+
+					uint64_t clipMask = BlockClipMask(blockX, blockY, blockMinX, blockMinY, blockMaxX, blockMaxY);
+
+					SoftRastCoverage blockCoverage = ClassifyRect(tri, blockMinX, blockMinY, blockMaxX, blockMaxY);
+					if (blockCoverage == SOFTRAST_COVERAGE_REJECT)
+					{
+						localStats.BlocksRejected++;
+						continue;
+					}
+
+					uint64_t mask = clipMask;
+					const uint8_t* blockSampleMasks = NULL;
+					if (blockCoverage == SOFTRAST_COVERAGE_ACCEPT)
+					{
+						localStats.BlocksAccepted++;
+					}
+					else
+					{
+						localStats.BlocksPartial++;
+
+						for (int i = 0; i < 3; i++)
+						{
+							edges.E0[i] = EdgeValueClamped(tri, i, blockX, blockY);
+						}
+
+						if (sampleCount > 1)
+						{
+							mask &= kernels->CoverageSamples8x8(&edges, sampleCount, sampleMasks);
+							blockSampleMasks = sampleMasks;
+						}
+						else
+						{
+							mask &= kernels->Coverage8x8(&edges);
+						}
+					}
+
+					RasterizeBlock(ctx, prim, blockX, blockY, mask, blockSampleMasks, pixelCounter, shade, pipelineStats, visibility);
+				}
+			}
+		}
+	}
+
+	if (stats)
+	{
+		SoftRastAddRasterStats(stats, localStats);
+	}
+}
+
+static uint32_t MortonCode(uint32_t x, uint32_t y)
+{
+	uint32_t code = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		code |= ((x >> i) & 1) << (2 * i);
+		code |= ((y >> i) & 1) << (2 * i + 1);
+	}
+	return code;
+}
+
+// Returns the bin indices (by * binsX + bx) in the order the back-end visits them.
+static std::vector<int> MakeBinOrder(int binsX, int binsY, SoftRastBinOrder order)
+{
+	std::vector<int> bins;
+	bins.reserve(binsX * binsY);
+
+	switch (order)
+	{
+	case SOFTRAST_BIN_ORDER_COLUMN_MAJOR:
+		for (int bx = 0; bx < binsX; bx++)
+			for (int by = 0; by < binsY; by++)
+				bins.push_back(by * binsX + bx);
+		break;
+	case SOFTRAST_BIN_ORDER_SERPENTINE:
+		for (int by = 0; by < binsY; by++)
+			for (int i = 0; i < binsX; i++)
+				bins.push_back(by * binsX + (by % 2 == 0 ? i : binsX - 1 - i));
+		break;
+	case SOFTRAST_BIN_ORDER_MORTON:
+		for (int b = 0; b < binsX * binsY; b++)
+			bins.push_back(b);
+		std::sort(bins.begin(), bins.end(), [binsX](int a, int b) {
+			return MortonCode(a % binsX, a / binsX) < MortonCode(b % binsX, b / binsX);
+		});
+		break;
+	default:
+		for (int b = 0; b < binsX * binsY; b++)
+			bins.push_back(b);
+		break;
+	}
+
+	return bins;
+}
+
+static uint32_t DrawImmediate(const SoftRastDrawContext* ctx, SoftRastRasterStats* stats, SoftRastPipelineStats* pipelineStats)
+{
+	TraceScope trace("draw immediate");
+
+	SoftRastRect viewportRect = { 0, 0, ctx->RT->Width - 1, ctx->RT->Height - 1 };
+
+	uint32_t pixelCounter = 0;
+
+	for (int triID = 0; triID < ctx->Params->NumTris; triID++)
+	{
+		SoftRastPrimitive prim;
+		if (!SetupPrimitive(ctx, &prim, (uint32_t)triID))
+			continue;
+
+		if (pipelineStats)
+			pipelineStats->Primitives++;
+
+		RasterizeTriangle(ctx, &prim, viewportRect, &pixelCounter, true, stats, pipelineStats, NULL);
+	}
+
+	return pixelCounter;
+}
+
+static uint32_t DrawBinned(const SoftRastDrawContext* ctx, SoftRastRasterStats* stats, SoftRastPipelineStats* pipelineStats)
+{
+	const SoftRastDrawParams* params = ctx->Params;
+	int binW = params->BinWidth;
+	int binH = params->BinHeight;
+	int binsX = (ctx->RT->Width + binW - 1) / binW;
+	int binsY = (ctx->RT->Height + binH - 1) / binH;
+	int numBins = binsX * binsY;
+
+	auto binRect = [&](int bin)
+	{
+		int bx = bin % binsX;
+		int by = bin / binsX;
+		SoftRastRect rect;
+		rect.MinX = bx * binW;
+		rect.MinY = by * binH;
+		rect.MaxX = std::min(rect.MinX + binW, ctx->RT->Width) - 1;
+		rect.MaxY = std::min(rect.MinY + binH, ctx->RT->Height) - 1;
+		return rect;
+	};
+
+	std::vector<int> binOrder = MakeBinOrder(binsX, binsY, params->BinOrder);
+
+	uint64_t vertexBytes = 3 * (uint64_t)(kSoftRastNumNonExtraFloats + ctx->NumExtraFloats) * sizeof(float);
+	SoftRastParamBufferStats paramBufferStats;
+	std::vector<uint64_t> binBytes(numBins);
+
+	std::vector<SoftRastPrimitive> prims;
+	std::vector<std::vector<uint32_t>> binPrims(numBins);
+	std::vector<int> triBins;
+
+	std::vector<uint32_t> binCounts(numBins);
+	std::vector<SoftRastRasterStats> binStats(stats ? numBins : 0);
+	std::vector<SoftRastPipelineStats> binPipelineStats(pipelineStats ? numBins : 0);
+	std::vector<uint64_t> binBases(numBins);
+	uint64_t total = 0;
+
+	int triID = 0;
+	while (triID < params->NumTris)
+	{
+		// front-end: run the vertex shader and sort the triangles into per-bin lists, keeping API order within each bin,
+		// until the parameter buffer is full
+		prims.clear();
+		for (std::vector<uint32_t>& list : binPrims)
+			list.clear();
+		uint64_t paramBufferUsed = 0;
+		uint64_t traceBegin = TraceIsEnabled() ? TraceNowNanoseconds() : 0;
+
+		for (; triID < params->NumTris; triID++)
+		{
+			SoftRastPrimitive prim;
+			if (!SetupPrimitive(ctx, &prim, (uint32_t)triID))
+				continue;
+
+			const SoftRastTriangle* tri = &prim.Tri;
+			triBins.clear();
+			for (int by = tri->MinY / binH; by <= tri->MaxY / binH; by++)
+			{
+				for (int bx = tri->MinX / binW; bx <= tri->MaxX / binW; bx++)
+				{
+					int bin = by * binsX + bx;
+					if (TriangleOverlapsRect(tri, binRect(bin)))
+					{
+						triBins.push_back(bin);
+					}
+				}
+			}
+
+			if (triBins.empty())
+				continue;
+
+			// a triangle that doesn't fit in an empty buffer is stored anyway
+			uint64_t triBytes = vertexBytes + triBins.size() * kSoftRastParamBufferEntryBytes;
+			if (params->ParamBufferSize > 0 && paramBufferUsed > 0 && paramBufferUsed + triBytes > params->ParamBufferSize)
+			{
+				paramBufferStats.Flushes++;
+				break;
+			}
+			paramBufferUsed += triBytes;
+
+			uint32_t primIndex = (uint32_t)prims.size();
+			prims.push_back(prim);
+			if (pipelineStats)
+				pipelineStats->Primitives++;
+
+			for (int bin : triBins)
+			{
+				binPrims[bin].push_back(primIndex);
+				binBytes[bin] += vertexBytes + kSoftRastParamBufferEntryBytes;
+			}
+		}
+
+		if (traceBegin)
+			TraceRecord("binning", "flushes", (int64_t)paramBufferStats.Flushes, traceBegin, TraceNowNanoseconds());
+
+		paramBufferStats.PeakBytes = std::max(paramBufferStats.PeakBytes, paramBufferUsed);
+		paramBufferStats.TotalBytes += paramBufferUsed;
+
+		// count the pixel shader invocations of each bin, so that the bins can be shaded in parallel
+		// while getting the same PixelCounterUAV values as shading them one after another.
+		// this pass sees every triangle of every bin, so it's also the one collecting the stats.
+		JobsParallelFor(numBins, 1, [&](int bin)
+		{
+			TraceScope trace("bin count", "bin", bin);
+			SoftRastRect rect = binRect(bin);
+			uint32_t pixelCounter = 0;
+			for (uint32_t primIndex : binPrims[bin])
+			{
+				RasterizeTriangle(ctx, &prims[primIndex], rect, &pixelCounter, false, stats ? &binStats[bin] : NULL, NULL, NULL);
+			}
+			binCounts[bin] = pixelCounter;
+		});
+
+		// each flush continues the counter where the previous one left it
+		for (int bin : binOrder)
+		{
+			binBases[bin] = total;
+			total += binCounts[bin];
+		}
+
+		// back-end: shade each bin, handing them out in traversal order
+		JobsParallelFor(numBins, 1, [&](int i)
+		{
+			int bin = binOrder[i];
+
+			// every pixel of the bin would be discarded (unless the 32-bit counter wraps around)
+			if (!params->OrderBuffer && binBases[bin] > params->MaxNumPixels && binBases[bin] + binCounts[bin] <= UINT32_MAX)
+			{
+				if (pipelineStats)
+				{
+					binPipelineStats[bin].PSInvocations += binCounts[bin];
+					binPipelineStats[bin].PSInvocationsDiscarded += binCounts[bin];
+				}
+				return;
+			}
+
+			TraceScope trace("bin shade", "bin", bin);
+			SoftRastRect rect = binRect(bin);
+
+			SoftRastBinVisibility visibility;
+			SoftRastBinVisibility* visibilityPtr = NULL;
+			if (ctx->RT->SampleCount == 1)
+			{
+				visibility.Rect = rect;
+				for (uint32_t primIndex : binPrims[bin])
+					visibility.Prims.push_back(&prims[primIndex]);
+				visibility.PixelLast.assign((size_t)(rect.MaxX - rect.MinX + 1) * (rect.MaxY - rect.MinY + 1), 0);
+				visibility.BlocksX = (rect.MaxX - (rect.MinX & ~7)) / 8 + 1;
+				visibility.BlockLast.assign((size_t)visibility.BlocksX * ((rect.MaxY - (rect.MinY & ~7)) / 8 + 1), 0);
+				visibilityPtr = &visibility;
+			}
+
+			uint32_t pixelCounter = (uint32_t)binBases[bin];
+			for (size_t binPrim = 0; binPrim < binPrims[bin].size(); binPrim++)
+			{
+				visibility.Current = (uint32_t)binPrim;
+				RasterizeTriangle(ctx, &prims[binPrims[bin][binPrim]], rect, &pixelCounter, true, NULL, pipelineStats ? &binPipelineStats[bin] : NULL, visibilityPtr);
+			}
+
+			if (visibilityPtr)
+				ShadeBinVisibility(ctx, visibilityPtr);
+		});
+	}
+
+	for (const SoftRastRasterStats& s : binStats)
+	{
+		SoftRastAddRasterStats(stats, s);
+	}
+
+	for (const SoftRastPipelineStats& s : binPipelineStats)
+	{
+		SoftRastAddPipelineStats(pipelineStats, s);
+	}
+
+	if (params->ParamBufferStats)
+	{
+		uint64_t sumBinBytes = 0;
+		for (uint64_t bytes : binBytes)
+		{
+			sumBinBytes += bytes;
+			paramBufferStats.MaxBinBytes = std::max(paramBufferStats.MaxBinBytes, bytes);
+		}
+		paramBufferStats.MeanBinBytes = (double)sumBinBytes / (double)numBins;
+		*params->ParamBufferStats = paramBufferStats;
+	}
+
+	return (uint32_t)total;
+}
+
+void SoftRastAddRasterStats(SoftRastRasterStats* dst, const SoftRastRasterStats& src)
+{
+	dst->TilesAccepted += src.TilesAccepted;
+	dst->TilesRejected += src.TilesRejected;
+	dst->TilesPartial += src.TilesPartial;
+	dst->BlocksAccepted += src.BlocksAccepted;
+	dst->BlocksRejected += src.BlocksRejected;
+	dst->BlocksPartial += src.BlocksPartial;
+}
+
+void SoftRastAddPipelineStats(SoftRastPipelineStats* dst, const SoftRastPipelineStats& src)
+{
+	dst->VSInvocations += src.VSInvocations;
+	dst->Primitives += src.Primitives;
+	dst->PSInvocations += src.PSInvocations;
+	dst->PSInvocationsDiscarded += src.PSInvocationsDiscarded;
+	dst->SamplesWritten += src.SamplesWritten;
+	dst->BytesWritten += src.BytesWritten;
+}
+
+static uint64_t CountUniqueVertices(const SoftRastDrawParams& params)
+{
+	std::vector<uint8_t> referenced(params.MeshNumVertices);
+	uint64_t numUnique = 0;
+	for (size_t i = 0; i < (size_t)std::max(params.NumTris, 0) * 3; i++)
+	{
+		uint32_t index = params.MeshIndices[i];
+		if (index < params.MeshNumVertices && !referenced[index])
+		{
+			referenced[index] = 1;
+			numUnique++;
+		}
+	}
+	return numUnique;
+}
+
+uint32_t SoftRastDraw(SoftRastTarget* rt, const SoftRastDrawParams& params, SoftRastRasterStats* stats)
+{
+	SoftRastDrawContext ctx;
+	ctx.RT = rt;
+	ctx.Params = &params;
+	ctx.NumExtraFloats = std::min(std::max(params.NumFloatsPerVertex - kSoftRastNumNonExtraFloats, 0), kSoftRastMaxExtraFloats);
+	ctx.Shade8x8 = SoftRastGetKernels()->Shade8x8[ctx.NumExtraFloats];
+	ctx.BytesPerSample = SoftRastBytesPerSample(rt->Format);
+
+	SoftRastPipelineStats pipelineStats;
+	SoftRastPipelineStats* pipelineStatsPtr = params.PipelineStats ? &pipelineStats : NULL;
+
+	uint32_t pixelCounter;
+	if (params.BinWidth > 0 && params.BinHeight > 0)
+	{
+		pixelCounter = DrawBinned(&ctx, stats, pipelineStatsPtr);
+	}
+	else
+	{
+		pixelCounter = DrawImmediate(&ctx, stats, pipelineStatsPtr);
+	}
+
+	if (params.PipelineStats)
+	{
+		if (!params.MeshIndexed)
+			pipelineStats.VSInvocations = 3 * (uint64_t)std::max(params.NumTris, 0);
+		else if (params.MeshVSInvocations > 0)
+			pipelineStats.VSInvocations = params.MeshVSInvocations;
+		else
+			pipelineStats.VSInvocations = CountUniqueVertices(params);
+		pipelineStats.BytesWritten = pipelineStats.SamplesWritten * ctx.BytesPerSample;
+		*params.PipelineStats = pipelineStats;
+	}
+
+	return pixelCounter;
+}
+
+void SoftRastResizeOrderBuffer(SoftRastOrderBuffer* ob, int width, int height, int sampleCount)
+{
+	ob->Width = width;
+	ob->Height = height;
+	ob->SampleCount = sampleCount;
+
+	size_t numSamples = (size_t)width * height * sampleCount;
+	ob->FirstOrder.resize(numSamples);
+	ob->FirstTriangleID.resize(numSamples);
+	ob->LastOrder.resize(numSamples);
+	ob->LastTriangleID.resize(numSamples);
+	SoftRastClearOrderBuffer(ob);
+}
+
+void SoftRastClearOrderBuffer(SoftRastOrderBuffer* ob)
+{
+	std::fill(ob->FirstOrder.begin(), ob->FirstOrder.end(), kSoftRastOrderNone);
+	std::fill(ob->FirstTriangleID.begin(), ob->FirstTriangleID.end(), kSoftRastOrderNone);
+	std::fill(ob->LastOrder.begin(), ob->LastOrder.end(), kSoftRastOrderNone);
+	std::fill(ob->LastTriangleID.begin(), ob->LastTriangleID.end(), kSoftRastOrderNone);
+}
+
+void SoftRastThresholdOrderBuffer(SoftRastTarget* rt, const SoftRastDrawParams& params, const SoftRastOrderBuffer* ob, const float clearColor[4])
+{
+	TraceScope trace("threshold");
+
+	SoftRastDrawContext ctx;
+	ctx.RT = rt;
+	ctx.Params = &params;
+	ctx.NumExtraFloats = std::min(std::max(params.NumFloatsPerVertex - kSoftRastNumNonExtraFloats, 0), kSoftRastMaxExtraFloats);
+	ctx.Shade8x8 = SoftRastGetKernels()->Shade8x8[ctx.NumExtraFloats];
+	ctx.BytesPerSample = SoftRastBytesPerSample(rt->Format);
+
+	uint32_t maxNumPixels = params.MaxNumPixels;
+
+	uint8_t encodedClear[16];
+	EncodeColor(encodedClear, rt->Format, clearColor);
+
+	// every sample gets written
+	SetTileStates(rt, SOFTRAST_TILE_WRITTEN);
+
+	JobsParallelFor(rt->Height, 8, [&](int y)
+	{
+		// neighboring samples mostly come from the same triangle
+		SoftRastPrimitive prim;
+		bool primValid = false;
+
+		// colors of the pixel's row of its 8x8 block for prim, shaded as the draw does
+		SoftRastBlockColors colors;
+		int colorsBlockX = -1;
+
+		for (int x = 0; x < rt->Width; x++)
+		{
+			// the order buffer is linear, the target can be tiled
+			size_t pixelIndex = (size_t)y * rt->Width + x;
+			size_t rtPixelIndex = SoftRastPixelIndex(rt, x, y);
+			for (int s = 0; s < rt->SampleCount; s++)
+			{
+				size_t index = pixelIndex * ob->SampleCount + s;
+				uint8_t* dst = &rt->Data[(rtPixelIndex * rt->SampleCount + s) * ctx.BytesPerSample];
+
+				uint32_t firstOrder = ob->FirstOrder[index];
+				uint32_t lastOrder = ob->LastOrder[index];
+				if (firstOrder == kSoftRastOrderNone || firstOrder > maxNumPixels)
+				{
+					memcpy(dst, encodedClear, ctx.BytesPerSample);
+					continue;
+				}
+
+				uint32_t triID = ob->LastTriangleID[index];
+				uint32_t firstTriID = ob->FirstTriangleID[index];
+				if (lastOrder > maxNumPixels && triID > firstTriID)
+				{
+					// invocations between two triangles covering this sample, in integers since floats can't hold large orders exactly
+					uint32_t stride = std::max((lastOrder - firstOrder) / (triID - firstTriID), 1u);
+					triID = firstTriID + (maxNumPixels - firstOrder) / stride;
+				}
+
+				if (!primValid || prim.ID != triID)
+				{
+					// an interpolated triangle can be one that got culled, fall back to the last one
+					primValid = SetupPrimitive(&ctx, &prim, triID) || SetupPrimitive(&ctx, &prim, ob->LastTriangleID[index]);
+					colorsBlockX = -1;
+				}
+
+				if (colorsBlockX != (x & ~7))
+				{
+					colorsBlockX = x & ~7;
+					ctx.Shade8x8(&colors, &prim.Planes, colorsBlockX, y & ~7, 1u << (y & 7));
+				}
+
+				float color[4];
+				GetBlockColor(color, &colors, (y & 7) * 8 + (x & 7));
+				EncodeColor(dst, rt->Format, color);
+			}
+
+			if (rt->SampleCount > 1)
+			{
+				const uint8_t* pixel = &rt->Data[rtPixelIndex * rt->SampleCount * ctx.BytesPerSample];
+				bool partial = false;
+				for (int s = 1; s < rt->SampleCount && !partial; s++)
+					partial = memcmp(pixel, pixel + s * ctx.BytesPerSample, ctx.BytesPerSample) != 0;
+				rt->PartialCoverage[rtPixelIndex] = partial;
+			}
+		}
+	});
+}
+
+void SoftRastResolve(SoftRastTarget* dst, const SoftRastTarget* src)
+{
+	int bps = SoftRastBytesPerSample(src->Format);
+	int sampleCount = src->SampleCount;
+
+	void(*resolve)(uint8_t*, const uint8_t*, int, int) = SoftRastGetKernels()->Resolve[src->Format];
+	int width = src->Width;
+
+	// every pixel gets written
+	SetTileStates(dst, SOFTRAST_TILE_WRITTEN);
+
+	// bands of one row of 8x8 tiles, the blocks the rasterizer shades
+	JobsParallelFor(src->TilesY, 1, [&](int tileY)
+	{
+		TraceScope trace("resolve", "tile row", tileY);
+		int y0 = tileY * 8;
+		int y1 = std::min(y0 + 8, src->Height);
+		for (int tileX = 0; tileX < src->TilesX; tileX++)
+		{
+			// the 8 pixels of each row of a tile are consecutive in both targets whatever their layouts
+			int x = tileX * 8;
+			int n = std::min(width - x, 8);
+
+			if (src->TileStates[(size_t)tileY * src->TilesX + tileX].load(std::memory_order_relaxed) == SOFTRAST_TILE_CLEARED)
+			{
+				for (int y = y0; y < y1; y++)
+					FillSamples(&dst->Data[SoftRastPixelIndex(dst, x, y) * bps], src->ClearValue, bps, n);
+				continue;
+			}
+
+			for (int y = y0; y < y1; y++)
+			{
+				size_t srcPixelIndex = SoftRastPixelIndex(src, x, y);
+				const uint8_t* srcPixels = &src->Data[srcPixelIndex * sampleCount * bps];
+				uint8_t* dstPixels = &dst->Data[SoftRastPixelIndex(dst, x, y) * bps];
+
+				if (sampleCount == 1)
+				{
+					memcpy(dstPixels, srcPixels, n * bps);
+					continue;
+				}
+
+				const uint8_t* partialCoverage = &src->PartialCoverage[srcPixelIndex];
+				uint64_t partial = 0;
+				if (n == 8)
+					memcpy(&partial, partialCoverage, 8);
+				else
+				{
+					for (int i = 0; i < n; i++)
+						partial |= partialCoverage[i];
+				}
+
+				if (partial)
+				{
+					resolve(dstPixels, srcPixels, n, sampleCount);
+					continue;
+				}
+
+				// all the samples of each pixel are equal
+				for (int i = 0; i < n; i++)
+					FillSamples(dstPixels + i * bps, srcPixels + (size_t)i * sampleCount * bps, bps, 1);
+			}
+		}
+	});
+}
+
+void SoftRastBlit(uint8_t* dst, int dstRowPitch, const SoftRastTarget* src)
+{
+	TraceScope trace("blit");
+
+	int bps = SoftRastBytesPerSample(src->Format);
+
+	float clearColor[4];
+	DecodeColor(clearColor, src->Format, src->ClearValue);
+
+	for (int y = 0; y < src->Height; y++)
+	{
+		uint8_t* dstRow = dst + (size_t)y * dstRowPitch;
+		for (int x = 0; x < src->Width; x++)
+		{
+			float color[4];
+			if (src->TileStates[(size_t)(y / 8) * src->TilesX + x / 8].load(std::memory_order_relaxed) == SOFTRAST_TILE_CLEARED)
+				memcpy(color, clearColor, sizeof(color));
+			else
+				DecodeColor(color, src->Format, &src->Data[SoftRastPixelIndex(src, x, y) * bps]);
+			EncodeColor(dstRow + x * 4, SOFTRAST_FORMAT_R8G8B8A8_UNORM, color);
+		}
+	}
+}
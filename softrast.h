@@ -0,0 +1,248 @@
+#pragma once
+
+// CPU implementation of the triangles pass (triangles.hlsl VSmain/PSmain),
+// for running the experiment without a D3D device.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// The vertex shader always outputs at least 8 floats:
+// float4 position, float4 color
+static const int kSoftRastNumNonExtraFloats = 8;
+static const int kSoftRastMaxExtraFloats = 24;
+
+// Triangles are rasterized hierarchically: coarse tiles, then 8x8 blocks, then pixels.
+static const int kSoftRastCoarseTileSize = 64;
+
+enum SoftRastFormat
+{
+	SOFTRAST_FORMAT_R8G8B8A8_UNORM,
+	SOFTRAST_FORMAT_R16G16B16A16_UNORM,
+	SOFTRAST_FORMAT_R32G32B32A32_FLOAT,
+	SOFTRAST_FORMAT_COUNT
+};
+
+// Sample counts of 1, 2, 4 and 8 are supported, with the D3D standard sample positions (D3D11_STANDARD_MULTISAMPLE_PATTERN).
+// Coverage is evaluated per sample and pixels are shaded once, at their center.
+static const int kSoftRastMaxSampleCount = 8;
+
+// Sample counts by index, as the Toolbox lists them and capture files and command lines store them.
+static const int kSoftRastSampleCounts[] = { 1, 2, 4, 8 };
+static const int kSoftRastNumSampleCounts = (int)(sizeof(kSoftRastSampleCounts) / sizeof(*kSoftRastSampleCounts));
+
+// Order of the pixels of a target in memory. Samples are always stored per pixel, so filling the samples of a row of pixels is a single contiguous write.
+enum SoftRastLayout
+{
+	// row-major, pixel (x,y) is pixel y * Width + x
+	SOFTRAST_LAYOUT_LINEAR,
+	// 8x8 micro-tiles of 64 consecutive pixels, row-major within the tile, tiles row-major over the target (padded to a multiple of 8 pixels),
+	// so an 8x8 block the rasterizer shades is a single contiguous range
+	SOFTRAST_LAYOUT_TILED,
+	SOFTRAST_LAYOUT_COUNT
+};
+
+enum SoftRastTileState
+{
+	SOFTRAST_TILE_CLEARED,
+	// being filled with the clear value by the thread that first wrote to it
+	SOFTRAST_TILE_MATERIALIZING,
+	SOFTRAST_TILE_WRITTEN
+};
+
+// Equivalent of a (multi-sampled) Texture2D.
+// Access pixels through SoftRastPixelIndex: sample s of pixel (x,y) is at (SoftRastPixelIndex(rt, x, y) * SampleCount + s).
+struct SoftRastTarget
+{
+	int Width;
+	int Height;
+	int SampleCount;
+	SoftRastFormat Format;
+	SoftRastLayout Layout;
+	std::vector<uint8_t> Data;
+
+	// Multi-sampled targets only: per pixel (indexed as the samples), 1 if its samples may differ, because a draw covered only some of them since the last clear.
+	// Draws keep it up to date, and the resolve copies the first sample of 8x8 tiles where it's all 0 instead of averaging.
+	std::vector<uint8_t> PartialCoverage;
+
+	// Fast clears: a clear only records its encoded value and marks every 8x8 tile (of pixels, whatever the layout) as cleared.
+	// A cleared tile's Data and PartialCoverage are stale until a draw first writes to the tile and fills it with the value,
+	// and the resolve and blit use the value instead of reading them.
+	uint8_t ClearValue[16];
+	int TilesX;
+	int TilesY;
+	// SoftRastTileState, row-major
+	std::unique_ptr<std::atomic<uint8_t>[]> TileStates;
+};
+
+// Index of pixel (x,y) in the storage order of the target's layout.
+// In both layouts, the 8 pixels of a row of an 8x8 block aligned on 8 pixels are consecutive.
+inline size_t SoftRastPixelIndex(const SoftRastTarget* rt, int x, int y)
+{
+	if (rt->Layout == SOFTRAST_LAYOUT_LINEAR)
+		return (size_t)y * rt->Width + x;
+
+	size_t tilesX = (size_t)(rt->Width + 7) >> 3;
+	return (((size_t)(y >> 3) * tilesX + (x >> 3)) << 6) + ((y & 7) << 3) + (x & 7);
+}
+
+static const uint32_t kSoftRastOrderNone = UINT32_MAX;
+
+// Records, for every sample, the PixelCounterUAV value of the first and last pixel shader invocations that covered it and the triangles being drawn.
+// Unlike the GPU's order capture, which is per pixel, samples a pixel's triangle doesn't cover aren't recorded.
+// A draw fills it in for every covered sample, whether the invocation got discarded by MaxNumPixels or not,
+// so the samples shaded with any MaxNumPixels are the ones with a first order <= MaxNumPixels.
+// Samples are stored per pixel: sample s of pixel (x,y) is at ((y * Width + x) * SampleCount + s).
+struct SoftRastOrderBuffer
+{
+	int Width;
+	int Height;
+	int SampleCount;
+	std::vector<uint32_t> FirstOrder;
+	std::vector<uint32_t> FirstTriangleID;
+	std::vector<uint32_t> LastOrder;
+	std::vector<uint32_t> LastTriangleID;
+};
+
+// Order in which the back-end walks the bins of a binned draw.
+enum SoftRastBinOrder
+{
+	SOFTRAST_BIN_ORDER_ROW_MAJOR,
+	SOFTRAST_BIN_ORDER_COLUMN_MAJOR,
+	SOFTRAST_BIN_ORDER_SERPENTINE,
+	SOFTRAST_BIN_ORDER_MORTON,
+	SOFTRAST_BIN_ORDER_COUNT
+};
+
+// Binned draws can model the fixed-capacity parameter buffer of a tiling GPU, which holds the vertex outputs and per-bin
+// triangle lists between binning and shading. Each binned triangle stores its 3 vertices (NumFloatsPerVertex floats each,
+// not shared between triangles) plus one list entry per bin it overlaps. When the next triangle doesn't fit,
+// the bins are shaded with the triangles binned so far (a partial flush), the buffer is emptied and binning resumes.
+static const int kSoftRastParamBufferEntryBytes = 8;
+
+struct SoftRastParamBufferStats
+{
+	// forced by the buffer filling up, not counting the flush at the end of the draw
+	uint64_t Flushes = 0;
+	// highest usage before a flush
+	uint64_t PeakBytes = 0;
+	// stored over the whole draw
+	uint64_t TotalBytes = 0;
+	// Bytes each bin reads over the whole draw: its list entries and the vertices of its triangles.
+	double MeanBinBytes = 0.0;
+	uint64_t MaxBinBytes = 0;
+};
+
+// What a draw invoked and wrote, counted as the Toolbox's pipeline statistics and occlusion queries count them on the GPU.
+struct SoftRastPipelineStats
+{
+	// 3 per triangle, or SoftRastDrawParams::MeshVSInvocations for indexed draws
+	uint64_t VSInvocations = 0;
+	// triangles left after culling, the ones rasterized
+	uint64_t Primitives = 0;
+	// one per covered pixel, as PixelCounterUAV counts them but without wrapping around
+	uint64_t PSInvocations = 0;
+	// by the MaxNumPixels check
+	uint64_t PSInvocationsDiscarded = 0;
+	uint64_t SamplesWritten = 0;
+	// to the drawn target, SamplesWritten times the bytes per sample
+	uint64_t BytesWritten = 0;
+};
+
+struct SoftRastDrawParams
+{
+	int NumTris = 0;
+	int NumFloatsPerVertex = kSoftRastNumNonExtraFloats;
+	uint32_t MaxNumPixels = 0;
+
+	// If MeshIndices isn't NULL, vertex VertexID is at position MeshPositions[MeshIndices[VertexID]] (float4s) instead of
+	// the half-screen triangle, as in triangles.hlsl with MESH, and NumTris must be at most the number of triangles in MeshIndices.
+	// Positions of out of range indices are (0,0,0,0), like out of bounds buffer reads.
+	const float* MeshPositions = NULL;
+	uint32_t MeshNumVertices = 0;
+	const uint32_t* MeshIndices = NULL;
+	// Equivalent of DrawIndexed instead of Draw: VertexID is the index itself rather than its position in MeshIndices,
+	// so all the outputs of a vertex shared by several triangles are the same, as in triangles.hlsl with INDEXED.
+	bool MeshIndexed = false;
+	// Vertex shader invocations of an indexed draw for PipelineStats, since vertices aren't shaded through a post-transform
+	// vertex cache: the misses VCacheSimulate counts. If 0, the unique vertices are counted, as a cache of unlimited size.
+	uint64_t MeshVSInvocations = 0;
+
+	// A bin size of 0 rasterizes in immediate mode: each triangle is drawn over the whole target before the next.
+	// Otherwise the draw is tile-binned (sort-middle): triangles are sorted into per-bin lists,
+	// then bins are shaded one after another in BinOrder, each bin drawing all of its triangles.
+	// Single-sampled, a bin's pixels are only shaded by the last of its triangles to reach them, which gives the same image.
+	int BinWidth = 0;
+	int BinHeight = 0;
+	// Bins are shaded in parallel by the job system (see jobs.h),
+	// but the PixelCounterUAV values are the same as if they were shaded one after another.
+	SoftRastBinOrder BinOrder = SOFTRAST_BIN_ORDER_ROW_MAJOR;
+
+	// Capacity of the modeled parameter buffer of binned draws in bytes, 0 for unlimited.
+	// Partial flushes change the PixelCounterUAV values, since each flush shades all of its bins before the next one starts.
+	uint64_t ParamBufferSize = 0;
+	// If not NULL, filled in by binned draws.
+	SoftRastParamBufferStats* ParamBufferStats = NULL;
+	// If not NULL, filled in.
+	SoftRastPipelineStats* PipelineStats = NULL;
+
+	// If not NULL, the order of the samples shaded by this draw is recorded. It must be cleared first.
+	SoftRastOrderBuffer* OrderBuffer = NULL;
+};
+
+// How many coarse tiles and 8x8 blocks were fully covered (accepted), not covered (rejected) or partially covered.
+// Blocks are only classified inside partially covered tiles.
+struct SoftRastRasterStats
+{
+	uint64_t TilesAccepted = 0;
+	uint64_t TilesRejected = 0;
+	uint64_t TilesPartial = 0;
+	uint64_t BlocksAccepted = 0;
+	uint64_t BlocksRejected = 0;
+	uint64_t BlocksPartial = 0;
+};
+
+void SoftRastAddRasterStats(SoftRastRasterStats* dst, const SoftRastRasterStats& src);
+void SoftRastAddPipelineStats(SoftRastPipelineStats* dst, const SoftRastPipelineStats& src);
+
+const char* SoftRastFormatName(SoftRastFormat format);
+const char* SoftRastBinOrderName(SoftRastBinOrder order);
+const char* SoftRastLayoutName(SoftRastLayout layout);
+int SoftRastBytesPerSample(SoftRastFormat format);
+
+// Returns the positions of the samples, as offsets {x, y} from the pixel center in 1/16ths of a pixel (y down),
+// or NULL if the sample count isn't supported.
+const int8_t (*SoftRastSamplePositions(int sampleCount))[2];
+
+// Same computation as the MaxNumPixelsCBV upload in ScenePaint.
+uint32_t SoftRastMaxNumPixels(float percent, int width, int height, int numTris);
+
+void SoftRastResize(SoftRastTarget* rt, int width, int height, SoftRastFormat format, int sampleCount, SoftRastLayout layout = SOFTRAST_LAYOUT_LINEAR);
+// O(tiles): the samples are only written when a draw touches their tile (see SoftRastTarget::TileStates).
+void SoftRastClear(SoftRastTarget* rt, const float color[4]);
+
+// Equivalent of Draw(NumTris * 3) with the triangles pipeline bound.
+// Returns the final value of the PixelCounterUAV counter (the number of pixel shader invocations).
+// If stats isn't NULL, the rasterizer's tile and block classification counts are added to it.
+uint32_t SoftRastDraw(SoftRastTarget* rt, const SoftRastDrawParams& params, SoftRastRasterStats* stats = NULL);
+
+void SoftRastResizeOrderBuffer(SoftRastOrderBuffer* ob, int width, int height, int sampleCount);
+void SoftRastClearOrderBuffer(SoftRastOrderBuffer* ob);
+
+// Rebuilds the image of a draw from its order buffer for params.MaxNumPixels, shading each sample once instead of rasterizing again.
+// params must be the ones of the draw that filled the order buffer, except for MaxNumPixels.
+// Samples whose first order is past MaxNumPixels get clearColor. The others get the color of their last triangle if it's shaded,
+// otherwise of the triangle interpolated linearly between their first and last ones from the orders, which is exact
+// as long as each triangle adds the same number of invocations before the sample (the case of overlapping triangles of equal size).
+// rt must have the same size and sample count as the order buffer. Same as threshold.hlsl.
+void SoftRastThresholdOrderBuffer(SoftRastTarget* rt, const SoftRastDrawParams& params, const SoftRastOrderBuffer* ob, const float clearColor[4]);
+
+// Equivalent of ResolveSubresource. dst must be single-sampled and of the same size and format as src, but can have another layout,
+// e.g. a linear dst to convert a tiled target only once it's complete.
+// Runs in parallel over bands of rows, with vectorized kernels (see softrast_kernels.h), skipping the averaging of uniform tiles.
+void SoftRastResolve(SoftRastTarget* dst, const SoftRastTarget* src);
+
+// Equivalent of the blit pass: converts a single-sampled target of any layout to linear R8G8B8A8_UNORM.
+void SoftRastBlit(uint8_t* dst, int dstRowPitch, const SoftRastTarget* src);
@@ -0,0 +1,849 @@
+#include "softrast_kernels.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SOFTRAST_X86 1
+#include <immintrin.h>
+#if !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC allows intrinsics of any ISA in any function, GCC and clang need them enabled per function.
+#if defined(_MSC_VER)
+#define SOFTRAST_TARGET(isa)
+#else
+#define SOFTRAST_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// Edge functions are integers, so all versions of a kernel give the same results.
+// E0 + 7 * (|DX| + |DY|) + |SampleDelta| fits in 32 bits (see EdgeValueClamped in softrast.cpp), so nothing overflows.
+
+static uint64_t Coverage8x8_Scalar(const SoftRastBlockEdges* edges)
+{
+	uint64_t mask = ~0ull;
+
+	for (int i = 0; i < 3; i++)
+	{
+		uint64_t edgeMask = 0;
+		int32_t rowE = edges->E0[i];
+		for (int y = 0; y < 8; y++)
+		{
+			int32_t e = rowE;
+			for (int x = 0; x < 8; x++)
+			{
+				edgeMask |= (uint64_t)(e >= 0) << (y * 8 + x);
+				e += edges->DX[i];
+			}
+			rowE += edges->DY[i];
+		}
+
+		mask &= edgeMask;
+	}
+
+	return mask;
+}
+
+static uint64_t CoverageSamples8x8_Scalar(const SoftRastBlockEdges* edges, int sampleCount, uint8_t sampleMasks[64])
+{
+	uint64_t mask = 0;
+
+	for (int y = 0; y < 8; y++)
+	{
+		for (int x = 0; x < 8; x++)
+		{
+			uint32_t samples = (1u << sampleCount) - 1;
+			for (int i = 0; i < 3; i++)
+			{
+				int32_t e = edges->E0[i] + edges->DX[i] * x + edges->DY[i] * y;
+				for (int s = 0; s < sampleCount; s++)
+				{
+					if (e + edges->SampleDelta[i][s] < 0)
+						samples &= ~(1u << s);
+				}
+			}
+
+			sampleMasks[y * 8 + x] = (uint8_t)samples;
+			mask |= (uint64_t)(samples != 0) << (y * 8 + x);
+		}
+	}
+
+	return mask;
+}
+
+// Resolve kernels are templates on the log2 of the sample count, dispatched by SOFTRAST_RESOLVE_DISPATCH.
+// Floats are summed in sample order, so all versions give the same results.
+#define SOFTRAST_RESOLVE_DISPATCH(kernel) \
+	static void kernel(uint8_t* dst, const uint8_t* src, int numPixels, int sampleCount) \
+	{ \
+		switch (sampleCount) \
+		{ \
+		case 2: kernel##T<1>(dst, src, numPixels); break; \
+		case 4: kernel##T<2>(dst, src, numPixels); break; \
+		default: kernel##T<3>(dst, src, numPixels); break; \
+		} \
+	}
+
+template <int Log2SampleCount>
+static void ResolveUNorm8_ScalarT(uint8_t* dst, const uint8_t* src, int numPixels)
+{
+	const int sampleCount = 1 << Log2SampleCount;
+	for (int p = 0; p < numPixels; p++)
+	{
+		const uint8_t* samples = src + (size_t)p * sampleCount * 4;
+		for (int c = 0; c < 4; c++)
+		{
+			uint32_t sum = sampleCount / 2;
+			for (int s = 0; s < sampleCount; s++)
+				sum += samples[s * 4 + c];
+			dst[p * 4 + c] = (uint8_t)(sum >> Log2SampleCount);
+		}
+	}
+}
+
+template <int Log2SampleCount>
+static void ResolveUNorm16_ScalarT(uint8_t* dst, const uint8_t* src, int numPixels)
+{
+	const int sampleCount = 1 << Log2SampleCount;
+	for (int p = 0; p < numPixels; p++)
+	{
+		const uint8_t* samples = src + (size_t)p * sampleCount * 8;
+		for (int c = 0; c < 4; c++)
+		{
+			uint32_t sum = sampleCount / 2;
+			for (int s = 0; s < sampleCount; s++)
+			{
+				uint16_t u;
+				memcpy(&u, samples + s * 8 + c * 2, sizeof(u));
+				sum += u;
+			}
+			uint16_t avg = (uint16_t)(sum >> Log2SampleCount);
+			memcpy(dst + p * 8 + c * 2, &avg, sizeof(avg));
+		}
+	}
+}
+
+template <int Log2SampleCount>
+static void ResolveFloat32_ScalarT(uint8_t* dst, const uint8_t* src, int numPixels)
+{
+	const int sampleCount = 1 << Log2SampleCount;
+	const float invSampleCount = 1.0f / (float)sampleCount;
+	for (int p = 0; p < numPixels; p++)
+	{
+		float samples[sampleCount * 4];
+		memcpy(samples, src + (size_t)p * sampleCount * 16, sizeof(samples));
+
+		float avg[4];
+		for (int c = 0; c < 4; c++)
+		{
+			float sum = samples[c];
+			for (int s = 1; s < sampleCount; s++)
+				sum += samples[s * 4 + c];
+			avg[c] = sum * invSampleCount;
+		}
+		memcpy(dst + p * 16, avg, sizeof(avg));
+	}
+}
+
+SOFTRAST_RESOLVE_DISPATCH(ResolveUNorm8_Scalar)
+SOFTRAST_RESOLVE_DISPATCH(ResolveUNorm16_Scalar)
+SOFTRAST_RESOLVE_DISPATCH(ResolveFloat32_Scalar)
+
+// Shade8x8 kernels evaluate varying i at pixel (x,y) of the block as (base[i] + DY[i] * y) + DX[i] * x,
+// with base[i] its value at the center of the block's top-left pixel, computed the same way by all ISAs.
+// AVX2 and AVX-512 fuse the multiply-adds, so float targets can differ from scalar and SSE2 in the last bits.
+
+static inline float BlockVaryingBase(const SoftRastVaryingPlanes* planes, int i, float ox, float oy)
+{
+	return planes->V0[i] + planes->DX[i] * ox + planes->DY[i] * oy;
+}
+
+// PSmain's weight of the extra floats, just to force them not to be optimized out (see triangles.hlsl)
+static const float kExtraFloatWeight = 0.00001f;
+
+template <int NumExtraFloats>
+static void Shade8x8_Scalar(SoftRastBlockColors* colors, const SoftRastVaryingPlanes* planes, int blockX, int blockY, uint32_t rowMask)
+{
+	const int numVaryings = 4 + NumExtraFloats;
+	float ox = (float)blockX + 0.5f - planes->X0;
+	float oy = (float)blockY + 0.5f - planes->Y0;
+
+	float base[numVaryings];
+	for (int i = 0; i < numVaryings; i++)
+		base[i] = BlockVaryingBase(planes, i, ox, oy);
+
+	for (int y = 0; y < 8; y++)
+	{
+		if (!(rowMask & (1u << y)))
+			continue;
+
+		float rowBase[numVaryings];
+		for (int i = 0; i < numVaryings; i++)
+			rowBase[i] = base[i] + planes->DY[i] * (float)y;
+
+		for (int x = 0; x < 8; x++)
+		{
+			float color[4];
+			for (int c = 0; c < 4; c++)
+				color[c] = rowBase[c] + planes->DX[c] * (float)x;
+
+			for (int i = 4; i < numVaryings; i++)
+				color[0] += (rowBase[i] + planes->DX[i] * (float)x) * kExtraFloatWeight;
+
+			for (int c = 0; c < 4; c++)
+				colors->C[c][y * 8 + x] = color[c];
+		}
+	}
+}
+
+#if SOFTRAST_X86
+
+SOFTRAST_TARGET("sse2")
+static uint64_t Coverage8x8_SSE2(const SoftRastBlockEdges* edges)
+{
+	uint64_t mask = ~0ull;
+	__m128i minusOne = _mm_set1_epi32(-1);
+
+	for (int i = 0; i < 3; i++)
+	{
+		// SSE2 has no 32-bit multiply
+		int32_t dx = edges->DX[i];
+		__m128i xoff0 = _mm_setr_epi32(0, dx, dx * 2, dx * 3);
+		__m128i xoff1 = _mm_add_epi32(xoff0, _mm_set1_epi32(dx * 4));
+
+		uint64_t edgeMask = 0;
+		int32_t rowE = edges->E0[i];
+		for (int y = 0; y < 8; y++)
+		{
+			__m128i r = _mm_set1_epi32(rowE);
+			__m128i in0 = _mm_cmpgt_epi32(_mm_add_epi32(r, xoff0), minusOne);
+			__m128i in1 = _mm_cmpgt_epi32(_mm_add_epi32(r, xoff1), minusOne);
+			int rowMask = _mm_movemask_ps(_mm_castsi128_ps(in0)) | (_mm_movemask_ps(_mm_castsi128_ps(in1)) << 4);
+			edgeMask |= (uint64_t)rowMask << (y * 8);
+			rowE += edges->DY[i];
+		}
+
+		mask &= edgeMask;
+	}
+
+	return mask;
+}
+
+SOFTRAST_TARGET("avx2")
+static uint64_t Coverage8x8_AVX2(const SoftRastBlockEdges* edges)
+{
+	uint64_t mask = ~0ull;
+	__m256i minusOne = _mm256_set1_epi32(-1);
+
+	for (int i = 0; i < 3; i++)
+	{
+		__m256i xoff = _mm256_mullo_epi32(_mm256_set1_epi32(edges->DX[i]), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+		uint64_t edgeMask = 0;
+		int32_t rowE = edges->E0[i];
+		for (int y = 0; y < 8; y++)
+		{
+			__m256i in = _mm256_cmpgt_epi32(_mm256_add_epi32(_mm256_set1_epi32(rowE), xoff), minusOne);
+			edgeMask |= (uint64_t)(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(in)) << (y * 8);
+			rowE += edges->DY[i];
+		}
+
+		mask &= edgeMask;
+	}
+
+	return mask;
+}
+
+SOFTRAST_TARGET("avx512f")
+static uint64_t Coverage8x8_AVX512(const SoftRastBlockEdges* edges)
+{
+	uint64_t mask = ~0ull;
+	__m512i zero = _mm512_setzero_si512();
+
+	for (int i = 0; i < 3; i++)
+	{
+		// two rows per vector
+		int32_t dx = edges->DX[i];
+		int32_t dy = edges->DY[i];
+		__m512i off = _mm512_add_epi32(
+			_mm512_mullo_epi32(_mm512_set1_epi32(dx), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7)),
+			_mm512_mask_blend_epi32(0xFF00, zero, _mm512_set1_epi32(dy)));
+
+		uint64_t edgeMask = 0;
+		int32_t rowE = edges->E0[i];
+		for (int y = 0; y < 8; y += 2)
+		{
+			__m512i e = _mm512_add_epi32(_mm512_set1_epi32(rowE), off);
+			__mmask16 in = _mm512_cmpge_epi32_mask(e, zero);
+			edgeMask |= (uint64_t)in << (y * 8);
+			rowE += dy * 2;
+		}
+
+		mask &= edgeMask;
+	}
+
+	return mask;
+}
+
+// A sample is outside if any of its 3 edge functions is negative, so or-ing them and testing the sign bit tests all 3 edges.
+
+SOFTRAST_TARGET("sse2")
+static uint64_t CoverageSamples8x8_SSE2(const SoftRastBlockEdges* edges, int sampleCount, uint8_t sampleMasks[64])
+{
+	// samples 0-3 and 4-7
+	__m128i delta0[3], delta1[3];
+	for (int i = 0; i < 3; i++)
+	{
+		delta0[i] = _mm_loadu_si128((const __m128i*)&edges->SampleDelta[i][0]);
+		delta1[i] = _mm_loadu_si128((const __m128i*)&edges->SampleDelta[i][4]);
+	}
+
+	int validSamples = (1 << sampleCount) - 1;
+	uint64_t mask = 0;
+
+	for (int y = 0; y < 8; y++)
+	{
+		int32_t e[3];
+		for (int i = 0; i < 3; i++)
+			e[i] = edges->E0[i] + edges->DY[i] * y;
+
+		for (int x = 0; x < 8; x++)
+		{
+			__m128i out0 = _mm_setzero_si128();
+			__m128i out1 = _mm_setzero_si128();
+			for (int i = 0; i < 3; i++)
+			{
+				__m128i pixelE = _mm_set1_epi32(e[i]);
+				out0 = _mm_or_si128(out0, _mm_add_epi32(pixelE, delta0[i]));
+				out1 = _mm_or_si128(out1, _mm_add_epi32(pixelE, delta1[i]));
+				e[i] += edges->DX[i];
+			}
+
+			int outside = _mm_movemask_ps(_mm_castsi128_ps(out0)) | (_mm_movemask_ps(_mm_castsi128_ps(out1)) << 4);
+			int samples = ~outside & validSamples;
+			sampleMasks[y * 8 + x] = (uint8_t)samples;
+			mask |= (uint64_t)(samples != 0) << (y * 8 + x);
+		}
+	}
+
+	return mask;
+}
+
+SOFTRAST_TARGET("avx2")
+static uint64_t CoverageSamples8x8_AVX2(const SoftRastBlockEdges* edges, int sampleCount, uint8_t sampleMasks[64])
+{
+	__m256i delta[3];
+	for (int i = 0; i < 3; i++)
+		delta[i] = _mm256_loadu_si256((const __m256i*)edges->SampleDelta[i]);
+
+	int validSamples = (1 << sampleCount) - 1;
+	uint64_t mask = 0;
+
+	for (int y = 0; y < 8; y++)
+	{
+		int32_t e[3];
+		for (int i = 0; i < 3; i++)
+			e[i] = edges->E0[i] + edges->DY[i] * y;
+
+		for (int x = 0; x < 8; x++)
+		{
+			__m256i out = _mm256_or_si256(
+				_mm256_or_si256(_mm256_add_epi32(_mm256_set1_epi32(e[0]), delta[0]), _mm256_add_epi32(_mm256_set1_epi32(e[1]), delta[1])),
+				_mm256_add_epi32(_mm256_set1_epi32(e[2]), delta[2]));
+			for (int i = 0; i < 3; i++)
+				e[i] += edges->DX[i];
+
+			int samples = ~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & validSamples;
+			sampleMasks[y * 8 + x] = (uint8_t)samples;
+			mask |= (uint64_t)(samples != 0) << (y * 8 + x);
+		}
+	}
+
+	return mask;
+}
+
+SOFTRAST_TARGET("avx512f")
+static uint64_t CoverageSamples8x8_AVX512(const SoftRastBlockEdges* edges, int sampleCount, uint8_t sampleMasks[64])
+{
+	// two pixels per vector, a pixel and the one to its right
+	__m512i delta[3], pixelStep[3];
+	for (int i = 0; i < 3; i++)
+	{
+		int32_t pairDelta[16];
+		memcpy(&pairDelta[0], edges->SampleDelta[i], sizeof(edges->SampleDelta[i]));
+		memcpy(&pairDelta[8], edges->SampleDelta[i], sizeof(edges->SampleDelta[i]));
+		delta[i] = _mm512_loadu_si512(pairDelta);
+		pixelStep[i] = _mm512_mask_blend_epi32(0xFF00, _mm512_setzero_si512(), _mm512_set1_epi32(edges->DX[i]));
+	}
+
+	uint32_t validSamples = (1u << sampleCount) - 1;
+	uint32_t validPair = validSamples | (validSamples << 8);
+	uint64_t mask = 0;
+
+	for (int y = 0; y < 8; y++)
+	{
+		int32_t e[3];
+		for (int i = 0; i < 3; i++)
+			e[i] = edges->E0[i] + edges->DY[i] * y;
+
+		for (int x = 0; x < 8; x += 2)
+		{
+			__m512i out = _mm512_setzero_si512();
+			for (int i = 0; i < 3; i++)
+			{
+				out = _mm512_or_si512(out, _mm512_add_epi32(_mm512_add_epi32(_mm512_set1_epi32(e[i]), pixelStep[i]), delta[i]));
+				e[i] += edges->DX[i] * 2;
+			}
+
+			uint32_t samples = (uint32_t)_mm512_cmpge_epi32_mask(out, _mm512_setzero_si512()) & validPair;
+			sampleMasks[y * 8 + x] = (uint8_t)samples;
+			sampleMasks[y * 8 + x + 1] = (uint8_t)(samples >> 8);
+			mask |= (uint64_t)((samples & 0xFF) != 0) << (y * 8 + x);
+			mask |= (uint64_t)((samples >> 8) != 0) << (y * 8 + x + 1);
+		}
+	}
+
+	return mask;
+}
+
+template <int NumExtraFloats>
+SOFTRAST_TARGET("sse2")
+static void Shade8x8_SSE2(SoftRastBlockColors* colors, const SoftRastVaryingPlanes* planes, int blockX, int blockY, uint32_t rowMask)
+{
+	const int numVaryings = 4 + NumExtraFloats;
+	float ox = (float)blockX + 0.5f - planes->X0;
+	float oy = (float)blockY + 0.5f - planes->Y0;
+
+	// left and right halves of a row
+	__m128 xs0 = _mm_setr_ps(0, 1, 2, 3);
+	__m128 xs1 = _mm_setr_ps(4, 5, 6, 7);
+	__m128 weight = _mm_set1_ps(kExtraFloatWeight);
+
+	__m128 base[numVaryings], dx[numVaryings], dy[numVaryings];
+	for (int i = 0; i < numVaryings; i++)
+	{
+		base[i] = _mm_set1_ps(BlockVaryingBase(planes, i, ox, oy));
+		dx[i] = _mm_set1_ps(planes->DX[i]);
+		dy[i] = _mm_set1_ps(planes->DY[i]);
+	}
+
+	for (int y = 0; y < 8; y++)
+	{
+		if (!(rowMask & (1u << y)))
+			continue;
+
+		__m128 ys = _mm_set1_ps((float)y);
+		__m128 color0[4], color1[4];
+		for (int c = 0; c < 4; c++)
+		{
+			__m128 rowBase = _mm_add_ps(base[c], _mm_mul_ps(dy[c], ys));
+			color0[c] = _mm_add_ps(rowBase, _mm_mul_ps(dx[c], xs0));
+			color1[c] = _mm_add_ps(rowBase, _mm_mul_ps(dx[c], xs1));
+		}
+
+		for (int i = 4; i < numVaryings; i++)
+		{
+			__m128 rowBase = _mm_add_ps(base[i], _mm_mul_ps(dy[i], ys));
+			color0[0] = _mm_add_ps(color0[0], _mm_mul_ps(_mm_add_ps(rowBase, _mm_mul_ps(dx[i], xs0)), weight));
+			color1[0] = _mm_add_ps(color1[0], _mm_mul_ps(_mm_add_ps(rowBase, _mm_mul_ps(dx[i], xs1)), weight));
+		}
+
+		for (int c = 0; c < 4; c++)
+		{
+			_mm_store_ps(&colors->C[c][y * 8], color0[c]);
+			_mm_store_ps(&colors->C[c][y * 8 + 4], color1[c]);
+		}
+	}
+}
+
+template <int NumExtraFloats>
+SOFTRAST_TARGET("avx2,fma")
+static void Shade8x8_AVX2(SoftRastBlockColors* colors, const SoftRastVaryingPlanes* planes, int blockX, int blockY, uint32_t rowMask)
+{
+	const int numVaryings = 4 + NumExtraFloats;
+	float ox = (float)blockX + 0.5f - planes->X0;
+	float oy = (float)blockY + 0.5f - planes->Y0;
+
+	__m256 xs = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256 weight = _mm256_set1_ps(kExtraFloatWeight);
+
+	__m256 base[numVaryings], dx[numVaryings], dy[numVaryings];
+	for (int i = 0; i < numVaryings; i++)
+	{
+		base[i] = _mm256_set1_ps(BlockVaryingBase(planes, i, ox, oy));
+		dx[i] = _mm256_set1_ps(planes->DX[i]);
+		dy[i] = _mm256_set1_ps(planes->DY[i]);
+	}
+
+	for (int y = 0; y < 8; y++)
+	{
+		if (!(rowMask & (1u << y)))
+			continue;
+
+		__m256 ys = _mm256_set1_ps((float)y);
+		__m256 color[4];
+		for (int c = 0; c < 4; c++)
+			color[c] = _mm256_fmadd_ps(dx[c], xs, _mm256_fmadd_ps(dy[c], ys, base[c]));
+
+		for (int i = 4; i < numVaryings; i++)
+		{
+			__m256 extraFloat = _mm256_fmadd_ps(dx[i], xs, _mm256_fmadd_ps(dy[i], ys, base[i]));
+			color[0] = _mm256_fmadd_ps(extraFloat, weight, color[0]);
+		}
+
+		for (int c = 0; c < 4; c++)
+			_mm256_store_ps(&colors->C[c][y * 8], color[c]);
+	}
+}
+
+template <int NumExtraFloats>
+SOFTRAST_TARGET("avx512f")
+static void Shade8x8_AVX512(SoftRastBlockColors* colors, const SoftRastVaryingPlanes* planes, int blockX, int blockY, uint32_t rowMask)
+{
+	const int numVaryings = 4 + NumExtraFloats;
+	float ox = (float)blockX + 0.5f - planes->X0;
+	float oy = (float)blockY + 0.5f - planes->Y0;
+
+	// two rows per vector
+	__m512 xs = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7);
+	__m512 rowOffset = _mm512_setr_ps(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+	__m512 weight = _mm512_set1_ps(kExtraFloatWeight);
+
+	__m512 base[numVaryings], dx[numVaryings], dy[numVaryings];
+	for (int i = 0; i < numVaryings; i++)
+	{
+		base[i] = _mm512_set1_ps(BlockVaryingBase(planes, i, ox, oy));
+		dx[i] = _mm512_set1_ps(planes->DX[i]);
+		dy[i] = _mm512_set1_ps(planes->DY[i]);
+	}
+
+	for (int y = 0; y < 8; y += 2)
+	{
+		uint32_t rows = (rowMask >> y) & 3;
+		if (!rows)
+			continue;
+
+		__mmask16 storeMask = (__mmask16)((rows & 1 ? 0x00FF : 0) | (rows & 2 ? 0xFF00 : 0));
+
+		__m512 ys = _mm512_add_ps(_mm512_set1_ps((float)y), rowOffset);
+		__m512 color[4];
+		for (int c = 0; c < 4; c++)
+			color[c] = _mm512_fmadd_ps(dx[c], xs, _mm512_fmadd_ps(dy[c], ys, base[c]));
+
+		for (int i = 4; i < numVaryings; i++)
+		{
+			__m512 extraFloat = _mm512_fmadd_ps(dx[i], xs, _mm512_fmadd_ps(dy[i], ys, base[i]));
+			color[0] = _mm512_fmadd_ps(extraFloat, weight, color[0]);
+		}
+
+		for (int c = 0; c < 4; c++)
+			_mm512_mask_store_ps(&colors->C[c][y * 8], storeMask, color[c]);
+	}
+}
+
+// A pixel's samples are widened and added 2 (UNORM16) or 4 (UNORM8) at a time, then the partial sums are added together.
+
+template <int Log2SampleCount>
+SOFTRAST_TARGET("sse2")
+static void ResolveUNorm8_SSE2T(uint8_t* dst, const uint8_t* src, int numPixels)
+{
+	const int sampleCount = 1 << Log2SampleCount;
+	__m128i zero = _mm_setzero_si128();
+	__m128i round = _mm_set1_epi16(sampleCount / 2);
+
+	for (int p = 0; p < numPixels; p++)
+	{
+		const uint8_t* samples = src + (size_t)p * sampleCount * 4;
+
+		// samples 0 and 1 in the low half, 2 and 3 in the high half
+		__m128i sum;
+		if (sampleCount == 2)
+		{
+			sum = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)samples), zero);
+		}
+		else
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)samples);
+			sum = _mm_add_epi16(_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero));
+			if (sampleCount == 8)
+			{
+				v = _mm_loadu_si128((const __m128i*)(samples + 16));
+				sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero)));
+			}
+		}
+		sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+
+		__m128i avg = _mm_srli_epi16(_mm_add_epi16(sum, round), Log2SampleCount);
+		int packed = _mm_cvtsi128_si32(_mm_packus_epi16(avg, avg));
+		memcpy(dst + p * 4, &packed, sizeof(packed));
+	}
+}
+
+template <int Log2SampleCount>
+SOFTRAST_TARGET("sse2")
+static void ResolveUNorm16_SSE2T(uint8_t* dst, const uint8_t* src, int numPixels)
+{
+	const int sampleCount = 1 << Log2SampleCount;
+	__m128i zero = _mm_setzero_si128();
+	__m128i round = _mm_set1_epi32(sampleCount / 2);
+	// SSE2 only packs signed 32-bit integers, so the averages are biased into their range and back
+	__m128i bias32 = _mm_set1_epi32(0x8000);
+	__m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+	for (int p = 0; p < numPixels; p++)
+	{
+		const uint8_t* samples = src + (size_t)p * sampleCount * 8;
+
+		__m128i sum = round;
+		for (int s = 0; s < sampleCount; s += 2)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(samples + s * 8));
+			sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero)));
+		}
+
+		__m128i avg = _mm_sub_epi32(_mm_srli_epi32(sum, Log2SampleCount), bias32);
+		avg = _mm_xor_si128(_mm_packs_epi32(avg, avg), bias16);
+		_mm_storel_epi64((__m128i*)(dst + p * 8), avg);
+	}
+}
+
+template <int Log2SampleCount>
+SOFTRAST_TARGET("sse2")
+static void ResolveFloat32_SSE2T(uint8_t* dst, const uint8_t* src, int numPixels)
+{
+	const int sampleCount = 1 << Log2SampleCount;
+	__m128 invSampleCount = _mm_set1_ps(1.0f / (float)sampleCount);
+
+	for (int p = 0; p < numPixels; p++)
+	{
+		const float* samples = (const float*)(src + (size_t)p * sampleCount * 16);
+
+		__m128 sum = _mm_loadu_ps(samples);
+		for (int s = 1; s < sampleCount; s++)
+			sum = _mm_add_ps(sum, _mm_loadu_ps(samples + s * 4));
+
+		_mm_storeu_ps((float*)(dst + p * 16), _mm_mul_ps(sum, invSampleCount));
+	}
+}
+
+SOFTRAST_RESOLVE_DISPATCH(ResolveUNorm8_SSE2)
+SOFTRAST_RESOLVE_DISPATCH(ResolveUNorm16_SSE2)
+SOFTRAST_RESOLVE_DISPATCH(ResolveFloat32_SSE2)
+
+// Two pixels per iteration, one per 128-bit lane. Floats still add the samples of a pixel in order.
+
+template <int Log2SampleCount>
+SOFTRAST_TARGET("avx2")
+static void ResolveUNorm8_AVX2T(uint8_t* dst, const uint8_t* src, int numPixels)
+{
+	const int sampleCount = 1 << Log2SampleCount;
+	if (sampleCount < 8)
+	{
+		ResolveUNorm8_SSE2T<Log2SampleCount>(dst, src, numPixels);
+		return;
+	}
+
+	__m256i round = _mm256_set1_epi16(sampleCount / 2);
+
+	int p = 0;
+	for (; p + 2 <= numPixels; p += 2)
+	{
+		const uint8_t* samples = src + (size_t)p * 32;
+
+		// the 8 samples of each pixel widened to 16 bits, 4 per 256-bit vector
+		__m256i p0 = _mm256_add_epi16(
+			_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)samples)),
+			_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(samples + 16))));
+		__m256i p1 = _mm256_add_epi16(
+			_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(samples + 32))),
+			_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(samples + 48))));
+
+		// pixel 0 in the low lane, pixel 1 in the high lane, 2 partial sums each
+		__m256i sum = _mm256_add_epi16(_mm256_permute2x128_si256(p0, p1, 0x20), _mm256_permute2x128_si256(p0, p1, 0x31));
+		sum = _mm256_add_epi16(sum, _mm256_srli_si256(sum, 8));
+
+		__m256i avg = _mm256_srli_epi16(_mm256_add_epi16(sum, round), Log2SampleCount);
+		__m256i packed = _mm256_packus_epi16(avg, avg);
+		int packed0 = _mm_cvtsi128_si32(_mm256_castsi256_si128(packed));
+		int packed1 = _mm_cvtsi128_si32(_mm256_extracti128_si256(packed, 1));
+		memcpy(dst + p * 4, &packed0, sizeof(packed0));
+		memcpy(dst + p * 4 + 4, &packed1, sizeof(packed1));
+	}
+
+	ResolveUNorm8_SSE2T<Log2SampleCount>(dst + p * 4, src + (size_t)p * 32, numPixels - p);
+}
+
+template <int Log2SampleCount>
+SOFTRAST_TARGET("avx2")
+static void ResolveUNorm16_AVX2T(uint8_t* dst, const uint8_t* src, int numPixels)
+{
+	const int sampleCount = 1 << Log2SampleCount;
+	__m128i round = _mm_set1_epi32(sampleCount / 2);
+
+	for (int p = 0; p < numPixels; p++)
+	{
+		const uint8_t* samples = src + (size_t)p * sampleCount * 8;
+
+		// 2 samples per vector, widened to 32 bits
+		__m256i sum = _mm256_setzero_si256();
+		for (int s = 0; s < sampleCount; s += 2)
+			sum = _mm256_add_epi32(sum, _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(samples + s * 8))));
+
+		__m128i pixelSum = _mm_add_epi32(_mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)), round);
+
+		__m128i avg = _mm_srli_epi32(pixelSum, Log2SampleCount);
+		_mm_storel_epi64((__m128i*)(dst + p * 8), _mm_packus_epi32(avg, avg));
+	}
+}
+
+template <int Log2SampleCount>
+SOFTRAST_TARGET("avx2")
+static void ResolveFloat32_AVX2T(uint8_t* dst, const uint8_t* src, int numPixels)
+{
+	const int sampleCount = 1 << Log2SampleCount;
+	__m256 invSampleCount = _mm256_set1_ps(1.0f / (float)sampleCount);
+
+	int p = 0;
+	for (; p + 2 <= numPixels; p += 2)
+	{
+		const float* samples0 = (const float*)(src + (size_t)p * sampleCount * 16);
+		const float* samples1 = samples0 + sampleCount * 4;
+
+		__m256 sum = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(samples0)), _mm_loadu_ps(samples1), 1);
+		for (int s = 1; s < sampleCount; s++)
+		{
+			__m256 v = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(samples0 + s * 4)), _mm_loadu_ps(samples1 + s * 4), 1);
+			sum = _mm256_add_ps(sum, v);
+		}
+
+		_mm256_storeu_ps((float*)(dst + p * 16), _mm256_mul_ps(sum, invSampleCount));
+	}
+
+	ResolveFloat32_SSE2T<Log2SampleCount>(dst + p * 16, src + (size_t)p * sampleCount * 16, numPixels - p);
+}
+
+SOFTRAST_RESOLVE_DISPATCH(ResolveUNorm8_AVX2)
+SOFTRAST_RESOLVE_DISPATCH(ResolveUNorm16_AVX2)
+SOFTRAST_RESOLVE_DISPATCH(ResolveFloat32_AVX2)
+
+static void CPUID(int leaf, int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+	int r[4];
+	__cpuidex(r, leaf, subleaf);
+	for (int i = 0; i < 4; i++)
+		regs[i] = (unsigned int)r[i];
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t XGETBV(unsigned int index)
+{
+#if defined(_MSC_VER)
+	return _xgetbv(index);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+#endif // SOFTRAST_X86
+
+static_assert(kSoftRastMaxExtraFloats == 24, "SOFTRAST_SHADE8X8_TABLE must have an entry per number of extra floats");
+
+#define SOFTRAST_SHADE8X8_TABLE(kernel) { \
+	kernel<0>, kernel<1>, kernel<2>, kernel<3>, kernel<4>, kernel<5>, kernel<6>, kernel<7>, kernel<8>, \
+	kernel<9>, kernel<10>, kernel<11>, kernel<12>, kernel<13>, kernel<14>, kernel<15>, kernel<16>, \
+	kernel<17>, kernel<18>, kernel<19>, kernel<20>, kernel<21>, kernel<22>, kernel<23>, kernel<24> }
+
+static const SoftRastKernels kKernels[SOFTRAST_ISA_COUNT] = {
+	{ Coverage8x8_Scalar, CoverageSamples8x8_Scalar, SOFTRAST_SHADE8X8_TABLE(Shade8x8_Scalar),
+		{ ResolveUNorm8_Scalar, ResolveUNorm16_Scalar, ResolveFloat32_Scalar } },
+#if SOFTRAST_X86
+	{ Coverage8x8_SSE2, CoverageSamples8x8_SSE2, SOFTRAST_SHADE8X8_TABLE(Shade8x8_SSE2),
+		{ ResolveUNorm8_SSE2, ResolveUNorm16_SSE2, ResolveFloat32_SSE2 } },
+	{ Coverage8x8_AVX2, CoverageSamples8x8_AVX2, SOFTRAST_SHADE8X8_TABLE(Shade8x8_AVX2),
+		{ ResolveUNorm8_AVX2, ResolveUNorm16_AVX2, ResolveFloat32_AVX2 } },
+	// the resolve is limited by memory bandwidth well before AVX2's width
+	{ Coverage8x8_AVX512, CoverageSamples8x8_AVX512, SOFTRAST_SHADE8X8_TABLE(Shade8x8_AVX512),
+		{ ResolveUNorm8_AVX2, ResolveUNorm16_AVX2, ResolveFloat32_AVX2 } },
+#else
+	{ Coverage8x8_Scalar, CoverageSamples8x8_Scalar, SOFTRAST_SHADE8X8_TABLE(Shade8x8_Scalar),
+		{ ResolveUNorm8_Scalar, ResolveUNorm16_Scalar, ResolveFloat32_Scalar } },
+	{ Coverage8x8_Scalar, CoverageSamples8x8_Scalar, SOFTRAST_SHADE8X8_TABLE(Shade8x8_Scalar),
+		{ ResolveUNorm8_Scalar, ResolveUNorm16_Scalar, ResolveFloat32_Scalar } },
+	{ Coverage8x8_Scalar, CoverageSamples8x8_Scalar, SOFTRAST_SHADE8X8_TABLE(Shade8x8_Scalar),
+		{ ResolveUNorm8_Scalar, ResolveUNorm16_Scalar, ResolveFloat32_Scalar } },
+#endif
+};
+
+static SoftRastISA g_ISA = SoftRastDetectISA();
+
+const char* SoftRastISAName(SoftRastISA isa)
+{
+	switch (isa)
+	{
+	case SOFTRAST_ISA_SCALAR: return "scalar";
+	case SOFTRAST_ISA_SSE2: return "sse2";
+	case SOFTRAST_ISA_AVX2: return "avx2";
+	case SOFTRAST_ISA_AVX512: return "avx512";
+	default: return "unknown";
+	}
+}
+
+SoftRastISA SoftRastDetectISA()
+{
+#if SOFTRAST_X86
+	unsigned int leaf0[4], leaf1[4], leaf7[4] = {};
+	CPUID(0, 0, leaf0);
+	CPUID(1, 0, leaf1);
+	if (leaf0[0] >= 7)
+		CPUID(7, 0, leaf7);
+
+	bool sse2 = (leaf1[3] >> 26) & 1;
+	if (!sse2)
+		return SOFTRAST_ISA_SCALAR;
+
+	// the OS has to save the AVX registers on context switches
+	bool osxsave = (leaf1[2] >> 27) & 1;
+	uint64_t xcr0 = osxsave ? XGETBV(0) : 0;
+	bool osAVX = (xcr0 & 0x6) == 0x6;
+	bool osAVX512 = (xcr0 & 0xE6) == 0xE6;
+
+	// the AVX2 kernels also use FMA
+	bool fma = (leaf1[2] >> 12) & 1;
+	bool avx2 = osAVX && fma && ((leaf7[1] >> 5) & 1);
+	// the AVX-512 table keeps the AVX2 and FMA resolve kernels
+	bool avx512f = avx2 && osAVX512 && ((leaf7[1] >> 16) & 1);
+
+	if (avx512f)
+		return SOFTRAST_ISA_AVX512;
+	if (avx2)
+		return SOFTRAST_ISA_AVX2;
+	return SOFTRAST_ISA_SSE2;
+#else
+	return SOFTRAST_ISA_SCALAR;
+#endif
+}
+
+bool SoftRastSetISA(SoftRastISA isa)
+{
+	if (isa < 0 || isa > SoftRastDetectISA())
+		return false;
+
+	g_ISA = isa;
+	return true;
+}
+
+SoftRastISA SoftRastGetISA()
+{
+	return g_ISA;
+}
+
+const SoftRastKernels* SoftRastGetKernels()
+{
+	return &kKernels[g_ISA];
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+// Vectorized inner loops of the CPU rasterizer.
+// Each kernel has a scalar version and SSE2/AVX2/AVX-512 versions, the best one supported by the CPU is picked at runtime.
+
+#include "softrast.h"
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+enum SoftRastISA
+{
+	SOFTRAST_ISA_SCALAR,
+	SOFTRAST_ISA_SSE2,
+	SOFTRAST_ISA_AVX2,
+	SOFTRAST_ISA_AVX512,
+	SOFTRAST_ISA_COUNT
+};
+
+// Integer edge functions of a triangle around an 8x8 pixel block.
+// A pixel is inside edge i if its edge function is >= 0, the top-left rule is already folded into E0.
+struct SoftRastBlockEdges
+{
+	// edge function values at the center of the block's top-left pixel
+	int32_t E0[3];
+
+	// edge function steps for one pixel right and one pixel down
+	int32_t DX[3];
+	int32_t DY[3];
+
+	// Multi-sample coverage: sample s of a pixel is inside edge i if the edge function at the pixel center plus SampleDelta[i][s] is >= 0.
+	// Entries past the sample count are ignored.
+	int32_t SampleDelta[3][kSoftRastMaxSampleCount];
+};
+
+// The color, then the extra floats.
+static const int kSoftRastMaxVaryings = 4 + kSoftRastMaxExtraFloats;
+
+// Plane equations of the varyings of a triangle, in structure-of-arrays form.
+// Varying i at (px,py) is V0[i] + DX[i] * (px - X0) + DY[i] * (py - Y0), where (X0,Y0) is the first vertex.
+struct SoftRastVaryingPlanes
+{
+	float X0, Y0;
+	float V0[kSoftRastMaxVaryings];
+	float DX[kSoftRastMaxVaryings];
+	float DY[kSoftRastMaxVaryings];
+};
+
+// PSmain output colors of an 8x8 block, in structure-of-arrays form: channel c of pixel (x,y) of the block is C[c][y * 8 + x].
+struct SoftRastBlockColors
+{
+	alignas(64) float C[4][64];
+};
+
+// Interpolates the varyings at the pixel centers of the rows of an 8x8 block in rowMask (bit y for row y), and runs PSmain on them.
+// Other rows of colors are left untouched.
+typedef void(*SoftRastShade8x8)(SoftRastBlockColors* colors, const SoftRastVaryingPlanes* planes, int blockX, int blockY, uint32_t rowMask);
+
+struct SoftRastKernels
+{
+	// Returns the coverage of an 8x8 block, bit (y * 8 + x) for pixel (x,y) of the block.
+	uint64_t(*Coverage8x8)(const SoftRastBlockEdges* edges);
+
+	// Writes the covered samples of each pixel of an 8x8 block to sampleMasks (bit s for sample s), evaluating all the samples of
+	// a pixel at once. Returns the pixels with at least one covered sample, in the same layout as Coverage8x8.
+	uint64_t(*CoverageSamples8x8)(const SoftRastBlockEdges* edges, int sampleCount, uint8_t sampleMasks[64]);
+
+	// Indexed by the number of extra floats, each specialized so that the loops over the varyings are unrolled.
+	SoftRastShade8x8 Shade8x8[kSoftRastMaxExtraFloats + 1];
+
+	// Indexed by format. Averages the samples of numPixels consecutive pixels (see SoftRastTarget for the layout)
+	// into single-sampled pixels, sampleCount being 2, 4 or 8. UNORM formats round the exact average to nearest, ties up.
+	void(*Resolve[SOFTRAST_FORMAT_COUNT])(uint8_t* dst, const uint8_t* src, int numPixels, int sampleCount);
+};
+
+const char* SoftRastISAName(SoftRastISA isa);
+
+// Returns the best ISA supported by the CPU and the OS.
+SoftRastISA SoftRastDetectISA();
+
+// Returns false if the ISA isn't supported. Otherwise, kernels are switched to it.
+bool SoftRastSetISA(SoftRastISA isa);
+SoftRastISA SoftRastGetISA();
+
+const SoftRastKernels* SoftRastGetKernels();
+
+static inline int SoftRastPopCount64(uint64_t x)
+{
+	x = x - ((x >> 1) & 0x5555555555555555ull);
+	x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return (int)((x * 0x0101010101010101ull) >> 56);
+}
+
+// x must not be 0
+static inline int SoftRastBitScanForward64(uint64_t x)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, x);
+	return (int)index;
+#else
+	return __builtin_ctzll(x);
+#endif
+}
@@ -0,0 +1,324 @@
+#include "sweep.h"
+#include "jobs.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+std::vector<SweepConfig> SweepEnumerate(const SweepConfig& base, const SweepAxes& axes)
+{
+	std::vector<WorkloadType> workloads = axes.Workloads.empty() ? std::vector<WorkloadType>{ base.Workload } : axes.Workloads;
+	std::vector<int> numTris = axes.NumTris.empty() ? std::vector<int>{ base.NumTris } : axes.NumTris;
+	std::vector<int> numFloats = axes.NumFloatsPerVertex.empty() ? std::vector<int>{ base.NumFloatsPerVertex } : axes.NumFloatsPerVertex;
+	std::vector<SoftRastFormat> formats = axes.Formats.empty() ? std::vector<SoftRastFormat>{ base.Format } : axes.Formats;
+	std::vector<int> sampleCounts = axes.SampleCounts.empty() ? std::vector<int>{ base.SampleCount } : axes.SampleCounts;
+
+	std::vector<SweepConfig> configs;
+	configs.reserve(workloads.size() * numTris.size() * numFloats.size() * formats.size() * sampleCounts.size());
+
+	for (WorkloadType workload : workloads)
+	{
+		for (int tris : numTris)
+		{
+			for (int floats : numFloats)
+			{
+				for (SoftRastFormat format : formats)
+				{
+					for (int samples : sampleCounts)
+					{
+						SweepConfig config = base;
+						config.Workload = workload;
+						config.NumTris = tris;
+						config.NumFloatsPerVertex = floats;
+						config.Format = format;
+						config.SampleCount = samples;
+						configs.push_back(config);
+					}
+				}
+			}
+		}
+	}
+
+	return configs;
+}
+
+// Appends lo to hi, unless they're out of range or would make the list too long.
+static bool AppendRange(std::vector<int>* list, long long lo, long long hi, int minValue, int maxValue)
+{
+	// checked before expanding, so that large ranges neither wrap around nor exhaust memory
+	if (lo < minValue || hi > maxValue)
+	{
+		fprintf(stderr, "Error: %lld out of range (%d to %d)\n", lo < minValue ? lo : hi, minValue, maxValue);
+		return false;
+	}
+
+	if (hi - lo + 1 > kSweepMaxListValues - (long long)list->size())
+	{
+		fprintf(stderr, "Error: more than %d values in a list\n", kSweepMaxListValues);
+		return false;
+	}
+
+	for (long long i = lo; i <= hi; i++)
+		list->push_back((int)i);
+	return true;
+}
+
+bool SweepParseIntList(std::vector<int>* list, const char* s, int minValue, int maxValue)
+{
+	list->clear();
+
+	if (!strcmp(s, "all"))
+	{
+		return AppendRange(list, minValue, maxValue, minValue, maxValue);
+	}
+
+	while (*s)
+	{
+		char* end;
+		long long lo = strtoll(s, &end, 10);
+		if (end == s)
+			return false;
+
+		long long hi = lo;
+		if (*end == '-')
+		{
+			s = end + 1;
+			hi = strtoll(s, &end, 10);
+			if (end == s || hi < lo)
+				return false;
+		}
+
+		if (!AppendRange(list, lo, hi, minValue, maxValue))
+			return false;
+
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return false;
+		s = end;
+	}
+
+	return !list->empty();
+}
+
+static uint64_t HashBytes(const std::vector<uint8_t>& data)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (uint8_t b : data)
+	{
+		hash ^= b;
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+static SweepResult RunConfig(int index, const SweepConfig& config)
+{
+	TraceScope trace("config", "index", index);
+
+	SweepResult result;
+	result.Index = index;
+	result.Config = config;
+
+	SoftRastTarget trianglesMS;
+	SoftRastTarget triangles;
+	SoftRastResize(&trianglesMS, config.Width, config.Height, config.Format, config.SampleCount, config.Layout);
+	SoftRastResize(&triangles, config.Width, config.Height, config.Format, 1);
+
+	SoftRastDrawParams params;
+	params.NumTris = config.NumTris;
+	if (config.Mesh)
+	{
+		params.NumTris = std::min(params.NumTris, (int)config.Mesh->NumTris);
+		params.MeshPositions = config.Mesh->Positions;
+		params.MeshNumVertices = config.Mesh->NumVertices;
+		params.MeshIndices = config.Mesh->Indices;
+	}
+
+	Workload workload;
+	if (!config.Mesh && config.Workload != WORKLOAD_HALF_SCREEN)
+	{
+		WorkloadParams workloadParams;
+		workloadParams.Type = config.Workload;
+		workloadParams.NumTris = config.NumTris;
+		workloadParams.Overlap = config.Overlap;
+		workloadParams.Seed = config.Seed;
+		WorkloadGenerate(&workload, workloadParams);
+
+		params.MeshPositions = workload.Positions.get();
+		params.MeshNumVertices = workload.NumVertices;
+		params.MeshIndices = workload.Indices.get();
+	}
+	params.MeshIndexed = config.Indexed && params.MeshIndices;
+	if (params.MeshIndexed)
+	{
+		VCacheStats vcacheStats;
+		VCacheSimulate(&vcacheStats, params.MeshIndices, (uint32_t)params.NumTris, params.MeshNumVertices, config.VCache);
+		params.MeshVSInvocations = vcacheStats.VertexShaderInvocations;
+	}
+	params.NumFloatsPerVertex = config.NumFloatsPerVertex;
+	params.MaxNumPixels = config.MaxNumPixels >= 0 ? (uint32_t)config.MaxNumPixels :
+		SoftRastMaxNumPixels(config.MaxNumPixelsPercent, config.Width, config.Height, params.NumTris);
+	result.Config.NumTris = params.NumTris;
+	params.BinWidth = config.BinWidth;
+	params.BinHeight = config.BinHeight;
+	params.BinOrder = config.BinOrder;
+	params.ParamBufferSize = config.ParamBufferSize;
+	SoftRastParamBufferStats paramBufferStats;
+	params.ParamBufferStats = &paramBufferStats;
+	params.PipelineStats = &result.PipelineStats;
+
+	SoftRastOrderBuffer orderBuffer;
+	if (config.CaptureOrder)
+	{
+		SoftRastResizeOrderBuffer(&orderBuffer, config.Width, config.Height, config.SampleCount);
+		params.OrderBuffer = &orderBuffer;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	uint64_t foreignStart = JobsGetForeignNanoseconds();
+
+	const float kClearColor[] = { 0, 0, 0, 0 };
+	SoftRastClear(&trianglesMS, kClearColor);
+	result.PixelShaderInvocations = SoftRastDraw(&trianglesMS, params);
+	SoftRastResolve(&triangles, &trianglesMS);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	uint64_t foreignNanoseconds = JobsGetForeignNanoseconds() - foreignStart;
+
+	result.MaxNumPixels = params.MaxNumPixels;
+	result.ParamBufferFlushes = paramBufferStats.Flushes;
+	result.ParamBufferPeakBytes = paramBufferStats.PeakBytes;
+	// without the other configurations this thread ran while waiting for the bins
+	result.Milliseconds = std::chrono::duration<double, std::milli>(end - start).count() - (double)foreignNanoseconds * 1e-6;
+	{
+		TraceScope traceHash("hash", "index", index);
+		result.ImageHash = HashBytes(triangles.Data);
+	}
+	return result;
+}
+
+void SweepRun(const std::vector<SweepConfig>& configs, const std::function<void(const SweepResult&)>& onResult)
+{
+	std::mutex resultMutex;
+
+	// one configuration per job: binned draws split into more jobs themselves, which idle workers steal
+	JobsParallelFor((int)configs.size(), 1, [&](int i)
+	{
+		SweepResult result = RunConfig(i, configs[i]);
+
+		std::lock_guard<std::mutex> lock(resultMutex);
+		TraceScope trace("export", "index", i);
+		onResult(result);
+	});
+}
+
+void SweepBeginOutput(SweepWriter* writer, FILE* file, SweepOutputFormat format)
+{
+	writer->File = file;
+	writer->Format = format;
+	writer->NumRows = 0;
+
+	if (format == SWEEP_OUTPUT_CSV)
+	{
+		fprintf(file, "index,capture,width,height,workload,overlap,tris,percent,floats,format,samples,layout,bin_width,bin_height,bin_order,param_buffer_bytes,max_pixels,ps_invocations,vs_invocations,primitives,ps_discarded,samples_written,bytes_written,flushes,peak_param_bytes,ms,image_hash\n");
+	}
+	else
+	{
+		fprintf(file, "[\n");
+	}
+
+	fflush(file);
+}
+
+// Quoted if not empty, with quotes doubled, so that commas don't start a new field.
+static std::string EscapeCSV(const char* s)
+{
+	std::string escaped;
+	if (!s || !*s)
+		return escaped;
+
+	escaped += '"';
+	for (; *s; s++)
+	{
+		if (*s == '"')
+			escaped += '"';
+		escaped += *s;
+	}
+	escaped += '"';
+	return escaped;
+}
+
+// Contents of a JSON string, e.g. for Windows paths.
+static std::string EscapeJSON(const char* s)
+{
+	std::string escaped;
+	for (; s && *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+		{
+			escaped += '\\';
+			escaped += *s;
+		}
+		else if ((unsigned char)*s < 0x20)
+		{
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", (unsigned char)*s);
+			escaped += code;
+		}
+		else
+		{
+			escaped += *s;
+		}
+	}
+	return escaped;
+}
+
+void SweepWriteResult(SweepWriter* writer, const SweepResult& result)
+{
+	const SweepConfig& c = result.Config;
+	const SoftRastPipelineStats& p = result.PipelineStats;
+
+	if (writer->Format == SWEEP_OUTPUT_CSV)
+	{
+		fprintf(writer->File, "%d,%s,%d,%d,%s,%g,%d,%g,%d,%s,%d,%s,%d,%d,%s,%llu,%u,%u,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.3f,%016llx\n",
+			result.Index, EscapeCSV(c.CapturePath).c_str(), c.Width, c.Height, WorkloadTypeName(c.Workload), c.Overlap, c.NumTris, c.MaxNumPixelsPercent, c.NumFloatsPerVertex,
+			SoftRastFormatName(c.Format), c.SampleCount, SoftRastLayoutName(c.Layout), c.BinWidth, c.BinHeight, SoftRastBinOrderName(c.BinOrder), (unsigned long long)c.ParamBufferSize,
+			result.MaxNumPixels, result.PixelShaderInvocations, (unsigned long long)p.VSInvocations, (unsigned long long)p.Primitives,
+			(unsigned long long)p.PSInvocationsDiscarded, (unsigned long long)p.SamplesWritten, (unsigned long long)p.BytesWritten,
+			(unsigned long long)result.ParamBufferFlushes, (unsigned long long)result.ParamBufferPeakBytes,
+			result.Milliseconds, (unsigned long long)result.ImageHash);
+	}
+	else
+	{
+		fprintf(writer->File,
+			"%s  { \"index\": %d, \"capture\": \"%s\", \"width\": %d, \"height\": %d, \"workload\": \"%s\", \"overlap\": %g, \"tris\": %d, \"percent\": %g, \"floats\": %d, \"format\": \"%s\", \"samples\": %d, \"layout\": \"%s\", "
+			"\"bin_width\": %d, \"bin_height\": %d, \"bin_order\": \"%s\", \"param_buffer_bytes\": %llu, \"max_pixels\": %u, \"ps_invocations\": %u, "
+			"\"vs_invocations\": %llu, \"primitives\": %llu, \"ps_discarded\": %llu, \"samples_written\": %llu, \"bytes_written\": %llu, "
+			"\"flushes\": %llu, \"peak_param_bytes\": %llu, \"ms\": %.3f, \"image_hash\": \"%016llx\" }",
+			writer->NumRows > 0 ? ",\n" : "",
+			result.Index, EscapeJSON(c.CapturePath).c_str(), c.Width, c.Height, WorkloadTypeName(c.Workload), c.Overlap, c.NumTris, c.MaxNumPixelsPercent, c.NumFloatsPerVertex,
+			SoftRastFormatName(c.Format), c.SampleCount, SoftRastLayoutName(c.Layout), c.BinWidth, c.BinHeight, SoftRastBinOrderName(c.BinOrder), (unsigned long long)c.ParamBufferSize,
+			result.MaxNumPixels, result.PixelShaderInvocations, (unsigned long long)p.VSInvocations, (unsigned long long)p.Primitives,
+			(unsigned long long)p.PSInvocationsDiscarded, (unsigned long long)p.SamplesWritten, (unsigned long long)p.BytesWritten,
+			(unsigned long long)result.ParamBufferFlushes, (unsigned long long)result.ParamBufferPeakBytes,
+			result.Milliseconds, (unsigned long long)result.ImageHash);
+	}
+
+	writer->NumRows++;
+	fflush(writer->File);
+}
+
+void SweepEndOutput(SweepWriter* writer)
+{
+	if (writer->Format == SWEEP_OUTPUT_JSON)
+	{
+		fprintf(writer->File, "%s]\n", writer->NumRows > 0 ? "\n" : "");
+	}
+
+	fflush(writer->File);
+}
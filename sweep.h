@@ -0,0 +1,111 @@
+#pragma once
+
+// Batch runs of the CPU triangles pass over the Cartesian product of the Toolbox parameters.
+
+#include "softrast.h"
+#include "mesh.h"
+#include "vcache.h"
+#include "workloads.h"
+
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+// One configuration of the triangles pass, as set in the Toolbox.
+struct SweepConfig
+{
+	int Width = 1280;
+	int Height = 720;
+	int NumTris = 0;
+	float MaxNumPixelsPercent = 0.0f;
+	// if >= 0, used instead of MaxNumPixelsPercent, as in captures
+	int64_t MaxNumPixels = -1;
+	int NumFloatsPerVertex = kSoftRastNumNonExtraFloats;
+	SoftRastFormat Format = SOFTRAST_FORMAT_R8G8B8A8_UNORM;
+	int SampleCount = 1;
+	// of the drawn target, the resolved one is linear
+	SoftRastLayout Layout = SOFTRAST_LAYOUT_LINEAR;
+	int BinWidth = 0;
+	int BinHeight = 0;
+	SoftRastBinOrder BinOrder = SOFTRAST_BIN_ORDER_ROW_MAJOR;
+	// see SoftRastDrawParams::ParamBufferSize
+	uint64_t ParamBufferSize = 0;
+	// NumTris triangles of this workload are generated and drawn, unless there's a mesh
+	WorkloadType Workload = WORKLOAD_HALF_SCREEN;
+	float Overlap = 1.0f;
+	uint32_t Seed = 1;
+	// if not NULL, the first NumTris triangles of the mesh are drawn
+	const MeshFile* Mesh = NULL;
+	// see SoftRastDrawParams::MeshIndexed
+	bool Indexed = false;
+	// of indexed draws, to count their vertex shader invocations
+	VCacheParams VCache;
+	// fill an order buffer during the draw, as the ORDER_CAPTURE shader permutation
+	bool CaptureOrder = false;
+	// the capture file replayed (see capture.h), if any
+	const char* CapturePath = NULL;
+};
+
+// Values taken by each swept parameter. An empty axis keeps the value of the base configuration.
+struct SweepAxes
+{
+	std::vector<WorkloadType> Workloads;
+	std::vector<int> NumTris;
+	std::vector<int> NumFloatsPerVertex;
+	std::vector<SoftRastFormat> Formats;
+	std::vector<int> SampleCounts;
+};
+
+struct SweepResult
+{
+	// index of the configuration in the sweep
+	int Index;
+	SweepConfig Config;
+	uint32_t MaxNumPixels;
+	uint32_t PixelShaderInvocations;
+	SoftRastPipelineStats PipelineStats;
+	// 0 for immediate mode draws
+	uint64_t ParamBufferFlushes;
+	uint64_t ParamBufferPeakBytes;
+	// time to clear, draw and resolve, without generating the workload, and without the jobs of other configurations
+	// the thread ran while waiting for this one's bins
+	double Milliseconds;
+	// FNV-1a of the resolved image, to compare the output of configurations or of runs
+	uint64_t ImageHash;
+};
+
+// values per parsed list
+static const int kSweepMaxListValues = 1 << 16;
+
+// Parses a list of axis values: "all" (minValue to maxValue), or comma-separated values and lo-hi ranges such as "0,100,500-510".
+// Fails, printing an error, if a value is outside [minValue, maxValue] or there are more than kSweepMaxListValues.
+bool SweepParseIntList(std::vector<int>* list, const char* s, int minValue, int maxValue);
+
+// Returns the configurations of the Cartesian product of the axes, from workloads varying slowest to sample counts varying fastest.
+std::vector<SweepConfig> SweepEnumerate(const SweepConfig& base, const SweepAxes& axes);
+
+// Renders every configuration, several at a time on the job system (see jobs.h).
+// onResult is called as each configuration completes, so in completion order rather than in index order,
+// but never from two threads at once.
+// Milliseconds are wall time, excluding other configurations' jobs run by the same thread (see JobsGetForeignNanoseconds),
+// but the other configurations still compete for the cores, so they're only comparable within a sweep.
+void SweepRun(const std::vector<SweepConfig>& configs, const std::function<void(const SweepResult&)>& onResult);
+
+enum SweepOutputFormat
+{
+	SWEEP_OUTPUT_CSV,
+	SWEEP_OUTPUT_JSON
+};
+
+// Streams results to a file, one row per result, flushed after each row.
+// JSON output is an array of objects that is only closed by SweepEndOutput.
+struct SweepWriter
+{
+	FILE* File;
+	SweepOutputFormat Format;
+	int NumRows;
+};
+
+void SweepBeginOutput(SweepWriter* writer, FILE* file, SweepOutputFormat format);
+void SweepWriteResult(SweepWriter* writer, const SweepResult& result);
+void SweepEndOutput(SweepWriter* writer);
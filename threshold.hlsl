@@ -0,0 +1,82 @@
+// Rebuilds the image of the triangles pass for another MaxNumPixels
+// from the shading order it captured with ORDER_CAPTURE, without drawing the triangles again.
+// Only for the half-screen triangle: the triangle of a pixel is guessed from its first and last orders.
+
+#include "triangles_common.hlsl"
+
+#define ORDER_NONE 0xFFFFFFFF
+
+Texture2D<uint> FirstOrderSRV : register(t0);
+Texture2D<uint> FirstTriangleIDSRV : register(t1);
+Texture2D<uint> LastOrderSRV : register(t2);
+Texture2D<uint> LastTriangleIDSRV : register(t3);
+cbuffer MaxNumPixelsCBV : register(b0) { uint MaxNumPixels; };
+
+float4 VSmain(VS_INPUT input) : SV_Position
+{
+	float4 position;
+	position.x = (float)(input.VertexID / 2) * 4.0 - 1.0;
+	position.y = (float)(input.VertexID % 2) * 4.0 - 1.0;
+	position.z = 0.0;
+	position.w = 1.0;
+	return position;
+}
+
+PS_OUTPUT PSmain(float4 Position : SV_Position)
+{
+	uint2 pixel = uint2(Position.xy);
+
+	uint firstOrder = FirstOrderSRV[pixel];
+	uint lastOrder = LastOrderSRV[pixel];
+	if (firstOrder == ORDER_NONE || firstOrder > MaxNumPixels)
+	{
+		discard;
+	}
+
+	// the last triangle shaded is the one that's visible (no blending, no depth test)
+	uint triangleID = LastTriangleIDSRV[pixel];
+	uint firstTriangleID = FirstTriangleIDSRV[pixel];
+	if (lastOrder > MaxNumPixels && triangleID > firstTriangleID)
+	{
+		// somewhere between the first and the last triangle of this pixel, assume the order grows linearly in between.
+		// in integers, since floats can't hold large orders exactly.
+		uint stride = max((lastOrder - firstOrder) / (triangleID - firstTriangleID), 1);
+		triangleID = firstTriangleID + (MaxNumPixels - firstOrder) / stride;
+	}
+
+	VS_OUTPUT verts[3];
+	float2 screen[3];
+	float2 viewportSize;
+	FirstOrderSRV.GetDimensions(viewportSize.x, viewportSize.y);
+
+	[unroll]
+	for (int v = 0; v < 3; v++)
+	{
+		verts[v] = TriangleVertex(CornerVertexID(triangleID * 3 + v));
+		screen[v] = (verts[v].Position.xy / verts[v].Position.w * float2(0.5, -0.5) + 0.5) * viewportSize;
+	}
+
+	// interpolate the vertex shader outputs at the pixel center
+	float2 e0 = screen[1] - screen[0];
+	float2 e1 = screen[2] - screen[0];
+	float2 p = Position.xy - screen[0];
+	float invArea = 1.0 / (e0.x * e1.y - e0.y * e1.x);
+	float b1 = (p.x * e1.y - p.y * e1.x) * invArea;
+	float b2 = (e0.x * p.y - e0.y * p.x) * invArea;
+	float b0 = 1.0 - b1 - b2;
+
+	VS_OUTPUT input;
+	input.Position = Position;
+	input.Color = b0 * verts[0].Color + b1 * verts[1].Color + b2 * verts[2].Color;
+#if NUM_EXTRA_FLOATs > 0
+	[unroll]
+	for (int i = 0; i < NUM_EXTRA_FLOATs; i++)
+	{
+		input.ExtraFloats[i] = b0 * verts[0].ExtraFloats[i] + b1 * verts[1].ExtraFloats[i] + b2 * verts[2].ExtraFloats[i];
+	}
+#endif
+
+	PS_OUTPUT output;
+	output.Color = TriangleColor(input);
+	return output;
+}
@@ -0,0 +1,94 @@
+#include "timing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// Each slot is a sequence lock: its sequence is odd while the frame in it is being written.
+// Readers skip the slots that don't hold the frame they expect, or that changed while they copied them.
+struct TimingSlot
+{
+	std::atomic<uint64_t> Sequence;
+	std::atomic<float> Ms[TIMING_PASS_COUNT];
+};
+
+static TimingSlot g_TimingSlots[kTimingMaxFrames];
+static std::atomic<uint64_t> g_TimingNumFrames;
+
+const char* TimingPassName(TimingPass pass)
+{
+	switch (pass)
+	{
+	case TIMING_PASS_CLEAR: return "clear";
+	case TIMING_PASS_TRIANGLES: return "triangles";
+	case TIMING_PASS_RESOLVE: return "resolve";
+	case TIMING_PASS_BLIT: return "blit";
+	case TIMING_PASS_IMGUI: return "imgui";
+	default: return "unknown";
+	}
+}
+
+void TimingPushFrame(const TimingFrame& frame)
+{
+	uint64_t index = g_TimingNumFrames.load(std::memory_order_relaxed);
+	TimingSlot& slot = g_TimingSlots[index % kTimingMaxFrames];
+
+	// sequence 2 * index + 1 while writing, 2 * index + 2 once written
+	slot.Sequence.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (int pass = 0; pass < TIMING_PASS_COUNT; pass++)
+		slot.Ms[pass].store(frame.Ms[pass], std::memory_order_relaxed);
+	slot.Sequence.store(2 * index + 2, std::memory_order_release);
+
+	g_TimingNumFrames.store(index + 1, std::memory_order_release);
+}
+
+int TimingGetFrames(TimingFrame* frames, int maxFrames)
+{
+	uint64_t numFrames = g_TimingNumFrames.load(std::memory_order_acquire);
+	uint64_t first = numFrames - std::min(numFrames, (uint64_t)std::min(maxFrames, kTimingMaxFrames));
+
+	int count = 0;
+	for (uint64_t index = first; index < numFrames; index++)
+	{
+		const TimingSlot& slot = g_TimingSlots[index % kTimingMaxFrames];
+
+		uint64_t sequence = slot.Sequence.load(std::memory_order_acquire);
+		TimingFrame frame;
+		frame.Index = index;
+		for (int pass = 0; pass < TIMING_PASS_COUNT; pass++)
+			frame.Ms[pass] = slot.Ms[pass].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (sequence != 2 * index + 2 || slot.Sequence.load(std::memory_order_relaxed) != sequence)
+			continue;
+
+		frames[count++] = frame;
+	}
+
+	return count;
+}
+
+void TimingGetPercentiles(TimingPercentiles percentiles[TIMING_PASS_COUNT], int numFrames)
+{
+	TimingFrame frames[kTimingMaxFrames];
+	int count = TimingGetFrames(frames, numFrames);
+
+	std::vector<float> ms;
+	ms.reserve(count);
+	for (int pass = 0; pass < TIMING_PASS_COUNT; pass++)
+	{
+		ms.clear();
+		for (int i = 0; i < count; i++)
+		{
+			if (frames[i].Ms[pass] >= 0.0f)
+				ms.push_back(frames[i].Ms[pass]);
+		}
+		std::sort(ms.begin(), ms.end());
+
+		TimingPercentiles& p = percentiles[pass];
+		p.NumFrames = (int)ms.size();
+		p.P50Ms = ms.empty() ? 0.0f : ms[(ms.size() * 50 + 99) / 100 - 1];
+		p.P99Ms = ms.empty() ? 0.0f : ms[(ms.size() * 99 + 99) / 100 - 1];
+	}
+}
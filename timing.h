@@ -0,0 +1,68 @@
+#pragma once
+
+// Per-pass timings of recent frames, kept in a fixed-size ring buffer.
+// The Toolbox times its passes on the GPU with timestamp queries (see gputiming.h), the headless tool on the CPU with TimingScope.
+// Frames are pushed by one thread and can be read from any thread, without locks.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+enum TimingPass
+{
+	TIMING_PASS_CLEAR,
+	// the draw, or the rebuild from the shading order cache
+	TIMING_PASS_TRIANGLES,
+	TIMING_PASS_RESOLVE,
+	TIMING_PASS_BLIT,
+	TIMING_PASS_IMGUI,
+	TIMING_PASS_COUNT
+};
+
+static const int kTimingMaxFrames = 256;
+
+struct TimingFrame
+{
+	uint64_t Index = 0;
+	// negative for passes that didn't run in the frame
+	float Ms[TIMING_PASS_COUNT] = { -1.0f, -1.0f, -1.0f, -1.0f, -1.0f };
+};
+
+struct TimingPercentiles
+{
+	// over the frames the pass ran in
+	int NumFrames;
+	float P50Ms;
+	float P99Ms;
+};
+
+const char* TimingPassName(TimingPass pass);
+
+// Only one thread may push frames. frame.Index is ignored, frames are indexed in the order they're pushed.
+void TimingPushFrame(const TimingFrame& frame);
+
+// Copies up to maxFrames of the most recent frames, oldest first, and returns their number.
+// Frames overwritten while being copied are skipped.
+int TimingGetFrames(TimingFrame* frames, int maxFrames);
+
+// Nearest-rank percentiles of the most recent numFrames frames.
+void TimingGetPercentiles(TimingPercentiles percentiles[TIMING_PASS_COUNT], int numFrames);
+
+// Adds the CPU time of its scope to a pass of frame.
+struct TimingScope
+{
+	TimingFrame* Frame;
+	TimingPass Pass;
+	std::chrono::high_resolution_clock::time_point Start;
+
+	TimingScope(TimingFrame* frame, TimingPass pass)
+		: Frame(frame), Pass(pass), Start(std::chrono::high_resolution_clock::now())
+	{
+	}
+
+	~TimingScope()
+	{
+		float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+		Frame->Ms[Pass] = std::max(Frame->Ms[Pass], 0.0f) + ms;
+	}
+};
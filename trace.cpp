@@ -0,0 +1,156 @@
+#include "trace.h"
+#include "jobs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent
+{
+	const char* Name;
+	const char* ArgName;
+	int64_t Arg;
+	uint64_t Begin;
+	uint64_t End;
+};
+
+// Only its thread writes to a buffer. Events below NumEvents are complete.
+struct TraceThreadBuffer
+{
+	std::unique_ptr<TraceEvent[]> Events;
+	std::atomic<int> NumEvents;
+	std::atomic<uint64_t> NumDropped;
+	int ThreadIndex;
+	int WorkerIndex;
+};
+
+std::atomic<bool> g_TraceEnabled;
+
+// buffers outlive their threads, so that workers that exited are still written
+static std::mutex g_TraceBuffersMutex;
+static std::vector<std::unique_ptr<TraceThreadBuffer>> g_TraceBuffers;
+static std::atomic<uint64_t> g_TraceStartNanoseconds;
+
+static thread_local TraceThreadBuffer* t_TraceBuffer;
+
+uint64_t TraceNowNanoseconds()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TraceSetEnabled(bool enabled)
+{
+	uint64_t none = 0;
+	if (enabled)
+		g_TraceStartNanoseconds.compare_exchange_strong(none, TraceNowNanoseconds());
+
+	g_TraceEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool TraceIsEnabled()
+{
+	return g_TraceEnabled.load(std::memory_order_relaxed);
+}
+
+// The first event of each thread registers its buffer, which is the only time recording takes a lock.
+static TraceThreadBuffer* GetThreadBuffer()
+{
+	if (!t_TraceBuffer)
+	{
+		std::unique_ptr<TraceThreadBuffer> buffer(new TraceThreadBuffer());
+		buffer->Events.reset(new TraceEvent[kTraceMaxEventsPerThread]);
+		buffer->WorkerIndex = JobsGetWorkerIndex();
+
+		std::lock_guard<std::mutex> lock(g_TraceBuffersMutex);
+		buffer->ThreadIndex = (int)g_TraceBuffers.size();
+		t_TraceBuffer = buffer.get();
+		g_TraceBuffers.push_back(std::move(buffer));
+	}
+
+	return t_TraceBuffer;
+}
+
+void TraceRecord(const char* name, const char* argName, int64_t arg, uint64_t beginNanoseconds, uint64_t endNanoseconds)
+{
+	TraceThreadBuffer* buffer = GetThreadBuffer();
+
+	int index = buffer->NumEvents.load(std::memory_order_relaxed);
+	if (index == kTraceMaxEventsPerThread)
+	{
+		buffer->NumDropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	TraceEvent& e = buffer->Events[index];
+	e.Name = name;
+	e.ArgName = argName;
+	e.Arg = arg;
+	e.Begin = beginNanoseconds;
+	e.End = endNanoseconds;
+	buffer->NumEvents.store(index + 1, std::memory_order_release);
+}
+
+bool TraceWrite(const char* path)
+{
+	FILE* f = fopen(path, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Error: could not open %s for writing\n", path);
+		return false;
+	}
+
+	uint64_t start = g_TraceStartNanoseconds.load();
+	uint64_t numDropped = 0;
+
+	std::lock_guard<std::mutex> lock(g_TraceBuffersMutex);
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"trianglebin\"}}");
+	for (const std::unique_ptr<TraceThreadBuffer>& buffer : g_TraceBuffers)
+	{
+		// sorted by worker, with the threads that aren't workers after them
+		int tid = buffer->WorkerIndex >= 0 ? buffer->WorkerIndex : JobsGetNumWorkers() + buffer->ThreadIndex;
+		if (buffer->WorkerIndex >= 0)
+			fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}", tid, buffer->WorkerIndex);
+		else
+			fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", tid, buffer->ThreadIndex);
+		fprintf(f, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}", tid, tid);
+
+		int numEvents = buffer->NumEvents.load(std::memory_order_acquire);
+		for (int i = 0; i < numEvents; i++)
+		{
+			const TraceEvent& e = buffer->Events[i];
+			// complete events, in microseconds
+			fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"trianglebin\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+				e.Name, tid, (double)(int64_t)(e.Begin - start) * 1e-3, (double)(e.End - e.Begin) * 1e-3);
+			if (e.ArgName)
+				fprintf(f, ",\"args\":{\"%s\":%lld}", e.ArgName, (long long)e.Arg);
+			fprintf(f, "}");
+		}
+
+		numDropped += buffer->NumDropped.load(std::memory_order_relaxed);
+	}
+	fprintf(f, "\n]}\n");
+
+	bool ok = !ferror(f);
+	fclose(f);
+	if (!ok)
+		fprintf(stderr, "Error: could not write %s\n", path);
+	if (numDropped > 0)
+		fprintf(stderr, "Warning: %llu trace events dropped, over %d per thread\n", (unsigned long long)numDropped, kTraceMaxEventsPerThread);
+	return ok;
+}
+
+void TraceReset()
+{
+	std::lock_guard<std::mutex> lock(g_TraceBuffersMutex);
+	for (const std::unique_ptr<TraceThreadBuffer>& buffer : g_TraceBuffers)
+	{
+		buffer->NumEvents.store(0, std::memory_order_relaxed);
+		buffer->NumDropped.store(0, std::memory_order_relaxed);
+	}
+	g_TraceStartNanoseconds.store(g_TraceEnabled.load() ? TraceNowNanoseconds() : 0);
+}
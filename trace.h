@@ -0,0 +1,49 @@
+#pragma once
+
+// Trace of the CPU triangles pass, per thread, written as Chrome trace events (chrome://tracing, ui.perfetto.dev):
+// front-end binning, the counting and shading of each bin, resolve, blit, sweep configurations and export.
+// Each thread records into its own buffer, without locks. Disabled, a TraceScope costs a relaxed load and a branch.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// events per thread, later ones are dropped
+static const int kTraceMaxEventsPerThread = 1 << 16;
+
+extern std::atomic<bool> g_TraceEnabled;
+
+// Can be toggled at any time, scopes that started while disabled aren't recorded.
+void TraceSetEnabled(bool enabled);
+bool TraceIsEnabled();
+
+// name and argName must outlive the trace, e.g. string literals. argName can be NULL.
+void TraceRecord(const char* name, const char* argName, int64_t arg, uint64_t beginNanoseconds, uint64_t endNanoseconds);
+uint64_t TraceNowNanoseconds();
+
+// Writes the events recorded so far as a JSON trace, with one track per thread.
+bool TraceWrite(const char* path);
+// Discards the events recorded so far. Must not be called while other threads record.
+void TraceReset();
+
+struct TraceScope
+{
+	const char* Name;
+	const char* ArgName;
+	int64_t Arg;
+	bool Enabled;
+	uint64_t Begin;
+
+	TraceScope(const char* name, const char* argName = NULL, int64_t arg = 0)
+		: Name(name), ArgName(argName), Arg(arg), Enabled(g_TraceEnabled.load(std::memory_order_relaxed)), Begin(0)
+	{
+		if (Enabled)
+			Begin = TraceNowNanoseconds();
+	}
+
+	~TraceScope()
+	{
+		if (Enabled)
+			TraceRecord(Name, ArgName, Arg, Begin, TraceNowNanoseconds());
+	}
+};
@@ -0,0 +1,92 @@
+struct VS_INPUT
+{
+	uint VertexID : SV_VertexID;
+};
+
+struct VS_OUTPUT
+{
+	float4 Position : SV_Position;
+	float4 Color : COLOR;
+#if NUM_EXTRA_FLOATs > 0
+	float ExtraFloats[NUM_EXTRA_FLOATs] : EXTRAFLOATS;
+#endif
+};
+
+struct PS_OUTPUT
+{
+	float4 Color : SV_Target;
+};
+
+#if MESH
+// Clip space positions and indices of a mesh file (see mesh.h), drawn instead of the half-screen triangle.
+// Vertices are pulled by SV_VertexID, so colors and extra floats still depend only on the vertex ID.
+StructuredBuffer<float4> MeshPositions : register(t4);
+Buffer<uint> MeshIndices : register(t5);
+#endif
+
+// SV_VertexID of corner (3 * triangle ID + i) of a triangle.
+// With INDEXED, the mesh is drawn with DrawIndexed and SV_VertexID is the index itself.
+uint CornerVertexID(uint Corner)
+{
+#if MESH && INDEXED
+	return MeshIndices[Corner];
+#else
+	return Corner;
+#endif
+}
+
+VS_OUTPUT TriangleVertex(uint VertexID)
+{
+	VS_OUTPUT output;
+
+#if MESH && INDEXED
+	output.Position = MeshPositions[VertexID];
+#elif MESH
+	output.Position = MeshPositions[MeshIndices[VertexID]];
+#else
+	if (VertexID % 3 == 0)
+		output.Position = float4(-1, 1, 0, 1);
+	else if (VertexID % 3 == 1)
+		output.Position = float4(1, 1, 0, 1);
+	else if (VertexID % 3 == 2)
+		output.Position = float4(-1, -1, 0, 1);
+#endif
+
+	const float4 colors[7] = {
+		float4(1,0,0,1),
+		float4(0,1,0,1),
+		float4(0,0,1,1),
+		float4(1,1,0,1),
+		float4(0,1,1,1),
+		float4(1,0,1,1),
+		float4(1,1,1,1)
+	};
+	
+	output.Color = colors[(VertexID / 3) % 7] * float4(0.4,0.4,0.4,1);
+
+#if NUM_EXTRA_FLOATs > 0
+	[unroll]
+	for (int i = 0; i < NUM_EXTRA_FLOATs; i++)
+	{
+		output.ExtraFloats[i] = VertexID + i;
+	}
+#endif
+
+	return output;
+}
+
+float4 TriangleColor(VS_OUTPUT input)
+{
+	float4 color = input.Color;
+
+	// just to force it not to optimize this out
+#if NUM_EXTRA_FLOATs > 0
+	[unroll]
+	for (int i = 0; i < NUM_EXTRA_FLOATs; i++)
+	{
+		color.r += input.ExtraFloats[i] * 0.00001;
+	}
+#endif
+
+	return color;
+}
@@ -0,0 +1,96 @@
+#include "vcache.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+static const int kVCacheMaxSize = 256;
+
+// batches per job
+static const int kVCacheBatchGrain = 64;
+
+const char* VCacheReplacementName(VCacheReplacement replacement)
+{
+	switch (replacement)
+	{
+	case VCACHE_FIFO: return "FIFO";
+	case VCACHE_LRU: return "LRU";
+	default: return "unknown";
+	}
+}
+
+// Returns the number of misses of one batch, starting from an empty cache.
+static uint64_t SimulateBatch(const uint32_t* indices, uint32_t numIndices, int cacheSize, VCacheReplacement replacement)
+{
+	// most recently inserted (FIFO) or used (LRU) first
+	uint32_t entries[kVCacheMaxSize];
+	int numEntries = 0;
+	uint64_t misses = 0;
+
+	for (uint32_t i = 0; i < numIndices; i++)
+	{
+		uint32_t vertex = indices[i];
+
+		int hit = -1;
+		for (int e = 0; e < numEntries; e++)
+		{
+			if (entries[e] == vertex)
+			{
+				hit = e;
+				break;
+			}
+		}
+
+		if (hit < 0)
+		{
+			misses++;
+			if (numEntries < cacheSize)
+				numEntries++;
+			memmove(&entries[1], &entries[0], (numEntries - 1) * sizeof(uint32_t));
+			entries[0] = vertex;
+		}
+		else if (replacement == VCACHE_LRU && hit > 0)
+		{
+			memmove(&entries[1], &entries[0], hit * sizeof(uint32_t));
+			entries[0] = vertex;
+		}
+	}
+
+	return misses;
+}
+
+void VCacheSimulate(VCacheStats* stats, const uint32_t* indices, uint32_t numTris, uint32_t numVertices, const VCacheParams& params)
+{
+	int cacheSize = std::min(std::max(params.CacheSize, 1), kVCacheMaxSize);
+	uint32_t batchTris = params.BatchTris > 0 ? (uint32_t)params.BatchTris : std::max(numTris, 1u);
+	uint32_t numBatches = (numTris + batchTris - 1) / batchTris;
+
+	std::atomic<uint64_t> misses(0);
+	JobsParallelFor((int)numBatches, kVCacheBatchGrain, [&](int batch)
+	{
+		uint32_t firstTri = (uint32_t)batch * batchTris;
+		uint32_t batchNumTris = std::min(batchTris, numTris - firstTri);
+		misses += SimulateBatch(&indices[(size_t)firstTri * 3], batchNumTris * 3, cacheSize, params.Replacement);
+	});
+
+	std::vector<uint8_t> referenced(numVertices);
+	uint64_t numUniqueVertices = 0;
+	for (size_t i = 0; i < (size_t)numTris * 3; i++)
+	{
+		uint32_t vertex = indices[i];
+		if (vertex < numVertices && !referenced[vertex])
+		{
+			referenced[vertex] = 1;
+			numUniqueVertices++;
+		}
+	}
+
+	stats->NumTris = numTris;
+	stats->NumUniqueVertices = numUniqueVertices;
+	stats->VertexShaderInvocations = misses;
+	stats->VertexShaderInvocationsSaved = (uint64_t)numTris * 3 - misses;
+	stats->ACMR = numTris > 0 ? (double)misses / (double)numTris : 0.0;
+	stats->ATVR = numUniqueVertices > 0 ? (double)misses / (double)numUniqueVertices : 0.0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Post-transform vertex cache simulator, to measure how much vertex shading and vertex output traffic
+// indexed drawing saves on a mesh, compared to shading the 3 corners of every triangle.
+
+#include <cstdint>
+
+enum VCacheReplacement
+{
+	// a hit doesn't change the order of the entries, misses evict the oldest one (as most GPUs)
+	VCACHE_FIFO,
+	// hits move the entry to the front, misses evict the least recently used one
+	VCACHE_LRU,
+	VCACHE_REPLACEMENT_COUNT
+};
+
+struct VCacheParams
+{
+	int CacheSize = 32;
+	VCacheReplacement Replacement = VCACHE_FIFO;
+	// Triangles are sent to the vertex stage in batches of this many triangles,
+	// each batch starting with an empty cache. 0 is one batch for the whole draw.
+	int BatchTris = 0;
+};
+
+struct VCacheStats
+{
+	uint64_t NumTris;
+	// vertices referenced at least once
+	uint64_t NumUniqueVertices;
+	// cache misses
+	uint64_t VertexShaderInvocations;
+	// compared to a non-indexed draw, which shades 3 vertices per triangle
+	uint64_t VertexShaderInvocationsSaved;
+
+	// average cache miss ratio: vertex shader invocations per triangle, 3 without reuse, 0.5 at best on large regular meshes
+	double ACMR;
+	// average transform to vertex ratio: vertex shader invocations per unique vertex, 1 at best
+	double ATVR;
+};
+
+const char* VCacheReplacementName(VCacheReplacement replacement);
+
+// Simulates an indexed draw of numTris triangles. Indices must be less than numVertices.
+// Batches are simulated in parallel on the job system (see jobs.h).
+void VCacheSimulate(VCacheStats* stats, const uint32_t* indices, uint32_t numTris, uint32_t numVertices, const VCacheParams& params);
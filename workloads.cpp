@@ -0,0 +1,322 @@
+#include "workloads.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float kPi = 3.14159265358979f;
+
+// elements (vertices or triangles) per job
+static const uint32_t kWorkloadChunkSize = 1 << 16;
+
+// Workloads are made of groups of triangles sharing vertices: a triangle, a quad, a grid layer, a fan or a strip.
+// All groups have the same number of vertices and triangles, except that the last group can have fewer triangles.
+struct WorkloadLayout
+{
+	const WorkloadParams* Params;
+	uint32_t VerticesPerGroup;
+	uint32_t TrisPerGroup;
+
+	// random: circumradius, slivers: area, fans: radius, strips: height
+	float Size;
+
+	// grid cells per layer
+	uint32_t CellsX;
+	uint32_t CellsY;
+};
+
+static const char* kWorkloadTypeNames[] = {
+	"half-screen",
+	"random",
+	"slivers",
+	"quads",
+	"grid",
+	"fans",
+	"strips"
+};
+
+const char* WorkloadTypeName(WorkloadType type)
+{
+	return type >= 0 && type < WORKLOAD_COUNT ? kWorkloadTypeNames[type] : "unknown";
+}
+
+static uint32_t Hash(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// k-th random number of a group, in [0,1)
+static float Random(uint32_t seed, uint32_t group, uint32_t k)
+{
+	uint32_t h = Hash(Hash(Hash(seed) ^ group) + k);
+	return (float)(h >> 8) * (1.0f / 16777216.0f);
+}
+
+static void SetPosition(float* pos, float x, float y)
+{
+	pos[0] = x;
+	pos[1] = y;
+	pos[2] = 0.0f;
+	pos[3] = 1.0f;
+}
+
+// Clip space y points up, so clockwise (front facing) triangles have decreasing angles around their center.
+static void GroupVertex(const WorkloadLayout& layout, uint32_t group, uint32_t v, float* pos)
+{
+	uint32_t seed = layout.Params->Seed;
+
+	switch (layout.Params->Type)
+	{
+	case WORKLOAD_RANDOM:
+	{
+		float cx = Random(seed, group, 0) * 2.0f - 1.0f;
+		float cy = Random(seed, group, 1) * 2.0f - 1.0f;
+		// corners are 120 degrees apart, give or take 30
+		float angle = Random(seed, group, 2) * 2.0f * kPi - (float)v * (2.0f * kPi / 3.0f) + (Random(seed, group, 3 + v) - 0.5f) * (kPi / 3.0f);
+		SetPosition(pos, cx + layout.Size * std::cos(angle), cy + layout.Size * std::sin(angle));
+		break;
+	}
+	case WORKLOAD_SLIVERS:
+	{
+		float cx = Random(seed, group, 0) * 2.0f - 1.0f;
+		float cy = Random(seed, group, 1) * 2.0f - 1.0f;
+		float angle = Random(seed, group, 2) * 2.0f * kPi;
+		float length = 0.5f + Random(seed, group, 3) * 1.5f;
+		float width = 2.0f * layout.Size / length;
+		float dx = std::cos(angle);
+		float dy = std::sin(angle);
+		if (v == 0)
+			SetPosition(pos, cx - dx * length * 0.5f, cy - dy * length * 0.5f);
+		else if (v == 1)
+			SetPosition(pos, cx + dx * length * 0.5f, cy + dy * length * 0.5f);
+		else
+			SetPosition(pos, cx + dy * width, cy - dx * width);
+		break;
+	}
+	case WORKLOAD_QUADS:
+	{
+		SetPosition(pos, (v & 1) ? 1.0f : -1.0f, (v & 2) ? -1.0f : 1.0f);
+		break;
+	}
+	case WORKLOAD_GRID:
+	{
+		uint32_t x = v % (layout.CellsX + 1);
+		uint32_t y = v / (layout.CellsX + 1);
+		SetPosition(pos, -1.0f + 2.0f * (float)x / (float)layout.CellsX, 1.0f - 2.0f * (float)y / (float)layout.CellsY);
+		break;
+	}
+	case WORKLOAD_FANS:
+	{
+		float cx = Random(seed, group, 0) * 2.0f - 1.0f;
+		float cy = Random(seed, group, 1) * 2.0f - 1.0f;
+		if (v == 0)
+		{
+			SetPosition(pos, cx, cy);
+		}
+		else
+		{
+			float angle = Random(seed, group, 2) * 2.0f * kPi - (float)(v - 1) * (2.0f * kPi / kWorkloadFanTris);
+			SetPosition(pos, cx + layout.Size * std::cos(angle), cy + layout.Size * std::sin(angle));
+		}
+		break;
+	}
+	case WORKLOAD_STRIPS:
+	{
+		float cy = Random(seed, group, 0) * 2.0f - 1.0f;
+		float column = (float)(v / 2) / (float)(kWorkloadStripTris / 2);
+		SetPosition(pos, -1.0f + 2.0f * column, cy + ((v & 1) ? -0.5f : 0.5f) * layout.Size);
+		break;
+	}
+	default:
+		SetPosition(pos, 0.0f, 0.0f);
+		break;
+	}
+}
+
+// indices relative to the group's first vertex
+static void GroupTriangle(const WorkloadLayout& layout, uint32_t t, uint32_t* indices)
+{
+	switch (layout.Params->Type)
+	{
+	case WORKLOAD_QUADS:
+	case WORKLOAD_GRID:
+	{
+		// top-left, top-right, bottom-left then bottom-left, top-right, bottom-right
+		uint32_t rowPitch = layout.Params->Type == WORKLOAD_GRID ? layout.CellsX + 1 : 2;
+		uint32_t cell = t / 2;
+		uint32_t topLeft = cell / (rowPitch - 1) * rowPitch + cell % (rowPitch - 1);
+		if (t % 2 == 0)
+		{
+			indices[0] = topLeft;
+			indices[1] = topLeft + 1;
+			indices[2] = topLeft + rowPitch;
+		}
+		else
+		{
+			indices[0] = topLeft + rowPitch;
+			indices[1] = topLeft + 1;
+			indices[2] = topLeft + rowPitch + 1;
+		}
+		break;
+	}
+	case WORKLOAD_FANS:
+	{
+		indices[0] = 0;
+		indices[1] = t + 1;
+		indices[2] = t + 2;
+		break;
+	}
+	case WORKLOAD_STRIPS:
+	{
+		// vertex 2 * i is the top of column i, 2 * i + 1 its bottom
+		uint32_t column = t / 2;
+		if (t % 2 == 0)
+		{
+			indices[0] = column * 2;
+			indices[1] = column * 2 + 2;
+			indices[2] = column * 2 + 1;
+		}
+		else
+		{
+			indices[0] = column * 2 + 1;
+			indices[1] = column * 2 + 2;
+			indices[2] = column * 2 + 3;
+		}
+		break;
+	}
+	default:
+		indices[0] = 0;
+		indices[1] = 1;
+		indices[2] = 2;
+		break;
+	}
+}
+
+static WorkloadLayout MakeLayout(const WorkloadParams& params)
+{
+	WorkloadLayout layout = {};
+	layout.Params = &params;
+
+	uint32_t numTris = (uint32_t)std::max(params.NumTris, 1);
+	float overlap = std::max(params.Overlap, 0.0f);
+
+	// clip space covers an area of 4
+	float areaPerTri = 4.0f * overlap / (float)numTris;
+
+	switch (params.Type)
+	{
+	case WORKLOAD_RANDOM:
+		layout.VerticesPerGroup = 3;
+		layout.TrisPerGroup = 1;
+		// area of an equilateral triangle of circumradius r: 3 * sqrt(3) / 4 * r^2
+		layout.Size = std::sqrt(areaPerTri / 1.29903811f);
+		break;
+	case WORKLOAD_SLIVERS:
+		layout.VerticesPerGroup = 3;
+		layout.TrisPerGroup = 1;
+		layout.Size = areaPerTri;
+		break;
+	case WORKLOAD_QUADS:
+		layout.VerticesPerGroup = 4;
+		layout.TrisPerGroup = 2;
+		break;
+	case WORKLOAD_GRID:
+	{
+		uint32_t numLayers = (uint32_t)std::max(std::lround(overlap), 1l);
+		uint32_t numCells = std::max((numTris / numLayers + 1) / 2, 1u);
+		layout.CellsX = (uint32_t)std::ceil(std::sqrt((double)numCells));
+		layout.CellsY = (numCells + layout.CellsX - 1) / layout.CellsX;
+		layout.VerticesPerGroup = (layout.CellsX + 1) * (layout.CellsY + 1);
+		layout.TrisPerGroup = numCells * 2;
+		break;
+	}
+	case WORKLOAD_FANS:
+	{
+		uint32_t numFans = (numTris + kWorkloadFanTris - 1) / kWorkloadFanTris;
+		layout.VerticesPerGroup = kWorkloadFanTris + 2;
+		layout.TrisPerGroup = kWorkloadFanTris;
+		layout.Size = std::sqrt(4.0f * overlap / (kPi * (float)numFans));
+		break;
+	}
+	case WORKLOAD_STRIPS:
+	{
+		uint32_t numStrips = (numTris + kWorkloadStripTris - 1) / kWorkloadStripTris;
+		layout.VerticesPerGroup = kWorkloadStripTris + 2;
+		layout.TrisPerGroup = kWorkloadStripTris;
+		// strips are 2 wide
+		layout.Size = 4.0f * overlap / (2.0f * (float)numStrips);
+		break;
+	}
+	default:
+		break;
+	}
+
+	return layout;
+}
+
+void WorkloadGenerate(Workload* workload, const WorkloadParams& params)
+{
+	WorkloadLayout layout = MakeLayout(params);
+
+	uint32_t numTris = params.Type == WORKLOAD_HALF_SCREEN ? 0 : (uint32_t)std::max(params.NumTris, 0);
+	uint32_t numGroups = numTris > 0 ? (numTris + layout.TrisPerGroup - 1) / layout.TrisPerGroup : 0;
+	uint32_t numVertices = numGroups * layout.VerticesPerGroup;
+
+	workload->Positions.reset(new float[(size_t)numVertices * 4]);
+	workload->Indices.reset(new uint32_t[(size_t)numTris * 3]);
+	workload->NumVertices = numVertices;
+	workload->NumTris = numTris;
+
+	float* positions = workload->Positions.get();
+	uint32_t* indices = workload->Indices.get();
+
+	// vertex chunks, then triangle chunks
+	uint32_t numVertexChunks = (numVertices + kWorkloadChunkSize - 1) / kWorkloadChunkSize;
+	uint32_t numTriChunks = (numTris + kWorkloadChunkSize - 1) / kWorkloadChunkSize;
+
+	JobsParallelFor((int)(numVertexChunks + numTriChunks), 1, [&](int chunk)
+	{
+		if ((uint32_t)chunk < numVertexChunks)
+		{
+			uint32_t first = (uint32_t)chunk * kWorkloadChunkSize;
+			uint32_t last = std::min(first + kWorkloadChunkSize, numVertices);
+			uint32_t group = first / layout.VerticesPerGroup;
+			uint32_t v = first % layout.VerticesPerGroup;
+			for (uint32_t i = first; i < last; i++)
+			{
+				GroupVertex(layout, group, v, &positions[(size_t)i * 4]);
+				if (++v == layout.VerticesPerGroup)
+				{
+					v = 0;
+					group++;
+				}
+			}
+		}
+		else
+		{
+			uint32_t first = ((uint32_t)chunk - numVertexChunks) * kWorkloadChunkSize;
+			uint32_t last = std::min(first + kWorkloadChunkSize, numTris);
+			uint32_t group = first / layout.TrisPerGroup;
+			uint32_t t = first % layout.TrisPerGroup;
+			for (uint32_t i = first; i < last; i++)
+			{
+				uint32_t* tri = &indices[(size_t)i * 3];
+				GroupTriangle(layout, t, tri);
+				uint32_t base = group * layout.VerticesPerGroup;
+				tri[0] += base;
+				tri[1] += base;
+				tri[2] += base;
+				if (++t == layout.TrisPerGroup)
+				{
+					t = 0;
+					group++;
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// Seeded synthetic workloads to stress binning, drawn like mesh files (see mesh.h) instead of the half-screen triangle.
+// Triangles are clockwise front faces in clip space (w = 1). Colors still come from the triangle ID, as with meshes.
+// The output only depends on the parameters, not on the number of job system workers generating it.
+
+#include <cstdint>
+#include <memory>
+
+enum WorkloadType
+{
+	// the half-screen triangle of triangles.hlsl, nothing is generated
+	WORKLOAD_HALF_SCREEN,
+	// small triangles at random positions and orientations
+	WORKLOAD_RANDOM,
+	// long thin triangles at random positions and orientations
+	WORKLOAD_SLIVERS,
+	// full-screen quads of 2 triangles, stacked (Overlap is ignored, it's NumTris / 2)
+	WORKLOAD_QUADS,
+	// layers of screen-covering grids of quads
+	WORKLOAD_GRID,
+	// triangle fans at random positions, kWorkloadFanTris triangles each
+	WORKLOAD_FANS,
+	// horizontal screen-wide triangle strips at random heights, kWorkloadStripTris triangles each
+	WORKLOAD_STRIPS,
+	WORKLOAD_COUNT
+};
+
+static const int kWorkloadFanTris = 32;
+static const int kWorkloadStripTris = 64;
+
+struct WorkloadParams
+{
+	WorkloadType Type = WORKLOAD_HALF_SCREEN;
+	int NumTris = 0;
+	// average number of triangles covering a pixel, which sets the size of the triangles
+	float Overlap = 1.0f;
+	uint32_t Seed = 1;
+};
+
+// Indexed triangles, in the layout of mesh files.
+struct Workload
+{
+	// float4 per vertex
+	std::unique_ptr<float[]> Positions;
+	// 3 per triangle
+	std::unique_ptr<uint32_t[]> Indices;
+	uint32_t NumVertices = 0;
+	uint32_t NumTris = 0;
+};
+
+const char* WorkloadTypeName(WorkloadType type);
+
+// Allocates the buffers and fills them in parallel chunks on the job system (see jobs.h).
+// The buffers aren't cleared first, each element is written once.
+void WorkloadGenerate(Workload* workload, const WorkloadParams& params);